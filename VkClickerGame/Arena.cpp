@@ -1,18 +1,125 @@
 #include "pch.h"
 #include "Arena.h"
 #include "Math.h"
+#include "ArenaBlockCache.h"
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
 
 namespace jv
 {
+	// Commits happen in steps of this size to keep the amount of system calls down. Multiple of the page size on all platforms.
+	constexpr uint32_t VIRTUAL_COMMIT_STEP = 4096 * 16;
+	// Largest alignment an allocation can ask for. Virtual memory is reserved at this alignment on all platforms.
+	constexpr uint32_t MAX_ALIGNMENT = 65536;
+
+	// Stored at the end of a snapshot file, so that the data itself starts at a page aligned file offset.
+	struct ArenaSnapshotHeader final
+	{
+		static constexpr uint64_t MAGIC = 0x544F4853414E4541;
+
+		uint64_t magic = MAGIC;
+		uint64_t front;
+		uint64_t rootOffset;
+		// Front padded to the commit step, which is what the data in the file takes up.
+		uint64_t dataSize;
+		// Alignment padding depends on the address of the arena, so a snapshot only loads into arenas at the same offset
+		// from a boundary of the largest alignment that was used.
+		uint64_t maxAlignment;
+		uint64_t baseOffset;
+	};
+
+	void* VirtualReserve(const size_t size)
+	{
+#ifdef _WIN32
+		void* ptr = VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+		// Mmap only aligns to pages, so a larger range is reserved and trimmed down to match the Windows alignment.
+		void* ptr = mmap(nullptr, size + MAX_ALIGNMENT, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (ptr == MAP_FAILED)
+			ptr = nullptr;
+		else
+		{
+			const auto pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+			const auto address = reinterpret_cast<uintptr_t>(ptr);
+			const auto end = address + size + MAX_ALIGNMENT;
+			const auto aligned = (address + MAX_ALIGNMENT - 1) & ~static_cast<uintptr_t>(MAX_ALIGNMENT - 1);
+			const auto alignedEnd = (aligned + size + pageSize - 1) & ~(pageSize - 1);
+			if (aligned > address)
+				munmap(ptr, aligned - address);
+			if (end > alignedEnd)
+				munmap(reinterpret_cast<void*>(alignedEnd), end - alignedEnd);
+			ptr = reinterpret_cast<void*>(aligned);
+		}
+#endif
+		if (!ptr)
+			throw std::exception("Unable to reserve virtual memory.");
+		return ptr;
+	}
+
+	void VirtualCommit(void* ptr, const size_t size)
+	{
+#ifdef _WIN32
+		const bool success = VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE);
+#else
+		// Mprotect wants page aligned addresses, while the chained arena header can sit anywhere in a page.
+		const auto pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+		const auto address = reinterpret_cast<uintptr_t>(ptr);
+		const auto start = address & ~(pageSize - 1);
+		const bool success = mprotect(reinterpret_cast<void*>(start), size + address - start, PROT_READ | PROT_WRITE) == 0;
+#endif
+		if (!success)
+			throw std::exception("Unable to commit virtual memory.");
+	}
+
+	void VirtualDecommit(void* ptr, const size_t size)
+	{
+#ifdef _WIN32
+		VirtualFree(ptr, size, MEM_DECOMMIT);
+#else
+		madvise(ptr, size, MADV_DONTNEED);
+		mprotect(ptr, size, PROT_NONE);
+#endif
+	}
+
+	void VirtualRelease(void* ptr, const size_t size)
+	{
+#ifdef _WIN32
+		VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+		munmap(ptr, size);
+#endif
+	}
+
 	Arena Arena::Create(const ArenaCreateInfo& info)
 	{
 		assert(info.memorySize > sizeof(Arena) + sizeof(ArenaAllocMetaData));
-		assert(info.alloc);
-		assert(info.free);
+		assert(info.memorySize < 1ull << 48);
+		assert(info.virtualMemory || info.alloc);
+		assert(info.virtualMemory || info.free);
+		assert(!info.virtualMemory || !info.memory);
+		assert(!info.virtualMemory || !info.cache);
 
 		Arena arena{};
 		arena.info = info;
-		arena.memory = info.memory ? info.memory : info.alloc(info.memorySize);
+		if (info.virtualMemory)
+			arena.memory = VirtualReserve(info.memorySize);
+		else if (info.memory)
+			arena.memory = info.memory;
+		else
+		{
+			// Cached blocks can be larger than requested, in which case the arena gets to use all of it.
+			arena.memory = info.cache ? info.cache->Acquire(info.memorySize, arena.info.memorySize) : nullptr;
+			arena.memory = arena.memory ? arena.memory : info.alloc(info.memorySize);
+		}
 		return arena;
 	}
 
@@ -20,136 +127,275 @@ namespace jv
 	{
 		if (arena.next)
 			Destroy(*arena.next);
-		if (!arena.info.memory)
+		if (arena.info.virtualMemory)
+			VirtualRelease(arena.memory, arena.info.memorySize);
+		else if (!arena.info.memory)
 			arena.info.free(arena.memory);
 	}
 
-	void* Arena::Alloc(uint32_t size)
+	void* Arena::Alloc(const uint64_t size)
 	{
-		bool goNext = false;
-		auto n = next;
-		while (n)
-		{
-			goNext = goNext ? true : n->front > 0;
-			n = n->next;
-		}
-		if (goNext)
-			return next->Alloc(size);
+		return AllocAligned(size, alignof(ArenaAllocMetaData));
+	}
 
-		size += (4 - size) % 4;
+	void* Arena::AllocAligned(uint64_t size, const uint32_t alignment)
+	{
+		assert(alignment > 0 && alignment <= MAX_ALIGNMENT && (alignment & (alignment - 1)) == 0);
+		constexpr uint64_t metaAlignment = alignof(ArenaAllocMetaData);
+		size = (size + metaAlignment - 1) & ~(metaAlignment - 1);
 
-		if (front + size + sizeof(ArenaAllocMetaData) > info.memorySize - sizeof(Arena))
+		maxAlignment = Max(maxAlignment, alignment);
+		Arena* current = tail ? tail : this;
+		uint32_t padding = GetPadding(*current, alignment);
+		while (current->front + padding + size + sizeof(ArenaAllocMetaData) > current->info.memorySize - sizeof(Arena))
 		{
-			if (!next)
+			if (!current->next)
 			{
-				const auto nextPtr = &static_cast<char*>(memory)[info.memorySize - sizeof(Arena)];
-				next = reinterpret_cast<Arena*>(nextPtr);
+				const auto nextPtr = &static_cast<char*>(current->memory)[current->info.memorySize - sizeof(Arena)];
+				if (info.virtualMemory)
+					VirtualCommit(nextPtr, sizeof(Arena));
+				Arena* next = reinterpret_cast<Arena*>(nextPtr);
 				ArenaCreateInfo createInfo = info;
 				createInfo.memory = nullptr;
-				createInfo.memorySize = Max<uint32_t>(createInfo.memorySize, size + sizeof(ArenaAllocMetaData) + sizeof(Arena));
+				createInfo.memorySize = Max<uint64_t>(createInfo.memorySize,
+					size + Max<uint64_t>(alignment, metaAlignment) + sizeof(ArenaAllocMetaData) + sizeof(Arena));
 				*next = Create(createInfo);
+				next->prev = current == this ? nullptr : current;
+				current->next = next;
 			}
 
-			return next->Alloc(size);
+			const uint64_t base = current->base + current->front;
+			current = current->next;
+			// Blocks past the old tail may still hold stale data from before a scope was destroyed.
+			current->front = 0;
+			current->base = base;
+			++tailDepth;
+			if (info.stats)
+			{
+				++info.stats->spills;
+				++info.stats->frameSpills;
+			}
+			padding = GetPadding(*current, alignment);
 		}
+		tail = current == this ? nullptr : current;
 
-		void* ptr = &static_cast<char*>(memory)[front];
-		front += size + sizeof(ArenaAllocMetaData);
-		const auto metaData = reinterpret_cast<ArenaAllocMetaData*>(&static_cast<char*>(memory)[front - sizeof(
+		void* ptr = &static_cast<char*>(current->memory)[current->front + padding];
+		current->front += padding + size + sizeof(ArenaAllocMetaData);
+		if (info.virtualMemory && current->front > current->committed)
+			Commit(*current, current->front);
+		const auto metaData = reinterpret_cast<ArenaAllocMetaData*>(&static_cast<char*>(current->memory)[current->front - sizeof(
 			ArenaAllocMetaData)]);
 		*metaData = ArenaAllocMetaData();
 		metaData->size = size;
+		metaData->padding = padding;
 
-#ifdef _DEBUG
-		const Arena* current = next;
-		while (current)
+		if (info.stats)
 		{
-			assert(current->front == 0);
-			current = current->next;
+			const uint64_t used = current->base + current->front;
+			++info.stats->allocations;
+			++info.stats->frameAllocations;
+			info.stats->peak = Max(info.stats->peak, used);
+			info.stats->framePeak = Max(info.stats->framePeak, used);
 		}
-#endif
-
 		return ptr;
 	}
 
 	void Arena::Free(const void* ptr)
 	{
-		const Arena* current = this;
-		while (current)
+		Arena* current = tail ? tail : this;
+
+		// The tail can be left empty after a free, in which case the front allocation lives in an earlier block.
+		while (current->front == 0 && current != this)
 		{
-			if (current->front == 0)
-				break;
+			current = current->prev ? current->prev : this;
+			--tailDepth;
+		}
+		tail = current == this ? nullptr : current;
 
-			const auto metaData = reinterpret_cast<ArenaAllocMetaData*>(&static_cast<char*>(memory)[front - sizeof(ArenaAllocMetaData)]);
-			const auto frontPtr = &static_cast<char*>(memory)[front - sizeof(ArenaAllocMetaData) - metaData->size];
+		if (current->front == 0)
+			throw std::exception("Pointer not in front of this arena.");
 
-			if (frontPtr == ptr)
-			{
-				front -= metaData->size + sizeof(ArenaAllocMetaData);
-
-#ifdef _DEBUG
-				current = current->next;
-				while (current)
-				{
-					assert(current->front == 0);
-					current = current->next;
-				}
-#endif
-				return;
-			}
+		const auto metaData = reinterpret_cast<ArenaAllocMetaData*>(&static_cast<char*>(current->memory)[current->front - sizeof(ArenaAllocMetaData)]);
+		const auto frontPtr = &static_cast<char*>(current->memory)[current->front - sizeof(ArenaAllocMetaData) - metaData->size];
 
-			current = current->next;
+		if (frontPtr != ptr)
+			throw std::exception("Pointer not in front of this arena.");
+		current->front -= metaData->padding + metaData->size + sizeof(ArenaAllocMetaData);
+		Decommit(*current);
+	}
+
+	bool Arena::Extend(const void* ptr, uint64_t size)
+	{
+		constexpr uint64_t metaAlignment = alignof(ArenaAllocMetaData);
+		size = (size + metaAlignment - 1) & ~(metaAlignment - 1);
+
+		Arena* current = tail ? tail : this;
+		if (current->front == 0)
+			return false;
+
+		const auto metaData = reinterpret_cast<ArenaAllocMetaData*>(&static_cast<char*>(current->memory)[current->front - sizeof(ArenaAllocMetaData)]);
+		const uint64_t start = current->front - sizeof(ArenaAllocMetaData) - metaData->size;
+		if (&static_cast<char*>(current->memory)[start] != ptr)
+			return false;
+		if (start + size + sizeof(ArenaAllocMetaData) > current->info.memorySize - sizeof(Arena))
+			return false;
+
+		const uint32_t padding = metaData->padding;
+		current->front = start + size + sizeof(ArenaAllocMetaData);
+		if (info.virtualMemory && current->front > current->committed)
+			Commit(*current, current->front);
+		const auto newMetaData = reinterpret_cast<ArenaAllocMetaData*>(&static_cast<char*>(current->memory)[current->front - sizeof(
+			ArenaAllocMetaData)]);
+		*newMetaData = ArenaAllocMetaData();
+		newMetaData->size = size;
+		newMetaData->padding = padding;
+		Decommit(*current);
+
+		if (info.stats)
+		{
+			const uint64_t used = current->base + current->front;
+			info.stats->peak = Max(info.stats->peak, used);
+			info.stats->framePeak = Max(info.stats->framePeak, used);
 		}
+		return true;
+	}
+
+	bool Arena::IsFront(const void* ptr) const
+	{
+		// Same walk as Free, which skips over tail blocks that were left empty.
+		const Arena* current = tail ? tail : this;
+		while (current->front == 0 && current != this)
+			current = current->prev ? current->prev : this;
+		if (current->front == 0)
+			return false;
 
-		throw std::exception("Pointer not in front of this arena.");
+		const auto metaData = reinterpret_cast<const ArenaAllocMetaData*>(&static_cast<const char*>(current->memory)[current->front - sizeof(ArenaAllocMetaData)]);
+		return &static_cast<const char*>(current->memory)[current->front - sizeof(ArenaAllocMetaData) - metaData->size] == ptr;
 	}
 
-	void Arena::Clear()
+	uint32_t Arena::GetPadding(const Arena& block, const uint32_t alignment)
 	{
-		front = 0;
-		if (next)
-			next->Clear();
+		const auto address = reinterpret_cast<uintptr_t>(&static_cast<char*>(block.memory)[block.front]);
+		return static_cast<uint32_t>((alignment - (address & (alignment - 1))) & (alignment - 1));
 	}
 
-	uint32_t Arena::GetTotalUsedMemory() const
+	void Arena::Commit(Arena& block, const uint64_t front)
 	{
-		uint32_t size = 0;
+		assert(block.info.virtualMemory);
+		const uint64_t usable = block.info.memorySize - sizeof(Arena);
+		const uint64_t target = Min<uint64_t>((front + VIRTUAL_COMMIT_STEP - 1) / VIRTUAL_COMMIT_STEP * VIRTUAL_COMMIT_STEP, usable);
+		VirtualCommit(&static_cast<char*>(block.memory)[block.committed], target - block.committed);
+		block.committed = target;
+	}
 
-		const Arena* current = this;
+	void Arena::Decommit(Arena& block)
+	{
+		if (!block.info.virtualMemory || block.committed - block.front <= block.info.decommitThreshold)
+			return;
+		const uint64_t target = (block.front + VIRTUAL_COMMIT_STEP - 1) / VIRTUAL_COMMIT_STEP * VIRTUAL_COMMIT_STEP;
+		// The OS decommits whole pages, so the page holding the chained arena header at the end of the block is never included.
+		// The part of the block in front of that page stays committed, and committing it again later is harmless.
+		const uint64_t usable = block.info.memorySize - sizeof(Arena);
+		const uint64_t end = Min<uint64_t>(block.committed, usable / VIRTUAL_COMMIT_STEP * VIRTUAL_COMMIT_STEP);
+		if (target >= end)
+			return;
+		VirtualDecommit(&static_cast<char*>(block.memory)[target], end - target);
+		block.committed = target;
+	}
+
+	void Arena::ReleaseChain(Arena& block)
+	{
+		if (!block.info.cache || !block.next)
+			return;
+
+		// The header of every chained block lives at the end of the block before it,
+		// so a block can only be handed back after the header of the next one has been read.
+		void* pending = nullptr;
+		uint64_t pendingSize = 0;
+		Arena* current = block.next;
+		block.next = nullptr;
 		while (current)
 		{
-			++size;
-			current = current->next;
+			Arena* next = current->next;
+			void* memory = current->memory;
+			const uint64_t size = current->info.memorySize;
+			if (pending)
+				block.info.cache->Release(pending, pendingSize);
+			pending = memory;
+			pendingSize = size;
+			current = next;
 		}
-		return size * info.memorySize;
+		block.info.cache->Release(pending, pendingSize);
 	}
 
-	void Arena::GetFront(uint32_t& depth, uint32_t& front) const
+	void Arena::DecommitChain(Arena& block)
 	{
-		depth = -1;
-		front = 0;
-		const Arena* current = this;
-		while (current)
+		// Virtual arenas rarely chain, so handing back the memory of every block is worth the walk.
+		if (!block.info.virtualMemory)
+			return;
+		for (Arena* current = block.next; current; current = current->next)
 		{
-			++depth;
-			front = current->front;
-			current = current->next;
+			current->front = 0;
+			Decommit(*current);
 		}
 	}
 
-	uint64_t Arena::CreateScope() const
+	void Arena::Clear()
 	{
+		front = 0;
+		Decommit(*this);
+		ReleaseChain(*this);
+		DecommitChain(*this);
+		tail = nullptr;
+		tailDepth = 0;
+		openScopes = 0;
+		maxAlignment = alignof(ArenaAllocMetaData);
+		if (info.stats)
+			info.stats->scopeDepth = 0;
+	}
+
+	uint64_t Arena::GetTotalUsedMemory() const
+	{
+		uint64_t size = 0;
+
 		const Arena* current = this;
-		uint32_t depth = 0;
-		while (current->next && current->next->front > 0)
+		while (current)
 		{
+			size += current->info.memorySize;
 			current = current->next;
-			++depth;
 		}
+		return size;
+	}
+
+	uint64_t Arena::GetUsedMemory() const
+	{
+		const Arena& current = tail ? *tail : *this;
+		return current.base + current.front;
+	}
+
+	void Arena::GetFront(uint32_t& depth, uint64_t& front) const
+	{
+		depth = tailDepth;
+		front = tail ? tail->front : this->front;
+	}
+
+	uint64_t Arena::CreateScope()
+	{
+		uint32_t depth;
+		uint64_t front;
+		GetFront(depth, front);
+		assert(depth <= UINT16_MAX);
 
 		Scope scope{};
 		scope.unpacked.depth = depth;
-		scope.unpacked.front = current->front;
+		scope.unpacked.front = front;
+		++openScopes;
+
+		if (info.stats)
+		{
+			++info.stats->scopeDepth;
+			info.stats->frameScopeDepth = Max(info.stats->frameScopeDepth, info.stats->scopeDepth);
+		}
 		return scope.handle;
 	}
 
@@ -157,12 +403,100 @@ namespace jv
 	{
 		Scope scope{};
 		scope.handle = handle;
+		assert(scope.unpacked.depth <= tailDepth);
+
+		// Only walks back over the blocks that were added since the scope was created.
+		Arena* current = tail ? tail : this;
+		for (uint32_t i = scope.unpacked.depth; i < tailDepth; ++i)
+			current = current->prev ? current->prev : this;
 
-		Arena* current = this;
-		for (uint32_t i = 0; i < scope.unpacked.depth; ++i)
-			current = current->next;
-		if (current->next)
-			current->next->Clear();
 		current->front = scope.unpacked.front;
+		Decommit(*current);
+		ReleaseChain(*current);
+		// Without a cache the blocks after this one stay chained, and would otherwise keep everything they committed.
+		DecommitChain(*current);
+		tail = current == this ? nullptr : current;
+		tailDepth = scope.unpacked.depth;
+		// Manual scopes can be left open, in which case the arena gets cleared without them.
+		if (openScopes > 0)
+			--openScopes;
+		if (info.stats && info.stats->scopeDepth > 0)
+			--info.stats->scopeDepth;
+	}
+
+	bool Arena::SaveSnapshot(const char* path, const uint64_t rootOffset) const
+	{
+		assert(!tail);
+		assert(rootOffset < front);
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		ArenaSnapshotHeader header{};
+		header.front = front;
+		header.rootOffset = rootOffset;
+		header.dataSize = (front + VIRTUAL_COMMIT_STEP - 1) / VIRTUAL_COMMIT_STEP * VIRTUAL_COMMIT_STEP;
+		header.maxAlignment = maxAlignment;
+		header.baseOffset = reinterpret_cast<uintptr_t>(memory) & (maxAlignment - 1);
+
+		file.write(static_cast<const char*>(memory), static_cast<std::streamsize>(front));
+		const char zero[256]{};
+		for (uint64_t i = front; i < header.dataSize; i += sizeof zero)
+			file.write(zero, static_cast<std::streamsize>(Min<uint64_t>(sizeof zero, header.dataSize - i)));
+		file.write(reinterpret_cast<const char*>(&header), sizeof header);
+		return file.good();
+	}
+
+	bool Arena::LoadSnapshot(const char* path, uint64_t& rootOffset)
+	{
+		assert(!tail && front == 0);
+
+		std::ifstream file(path, std::ios::ate | std::ios::binary);
+		if (!file.is_open())
+			return false;
+
+		ArenaSnapshotHeader header{};
+		const uint64_t fileSize = file.tellg();
+		if (fileSize < sizeof header)
+			return false;
+		file.seekg(static_cast<std::streamoff>(fileSize - sizeof header));
+		file.read(reinterpret_cast<char*>(&header), sizeof header);
+		if (!file.good() || header.magic != ArenaSnapshotHeader::MAGIC || header.dataSize + sizeof header != fileSize)
+			return false;
+		if (header.front > info.memorySize - sizeof(Arena))
+			return false;
+		if (header.maxAlignment == 0 || header.maxAlignment > MAX_ALIGNMENT || header.baseOffset != (reinterpret_cast<uintptr_t>(memory) & (header.maxAlignment - 1)))
+			return false;
+
+#ifndef _WIN32
+		if (info.virtualMemory && header.dataSize <= info.memorySize - sizeof(Arena))
+		{
+			// A private mapping is copy on write, so the arena can keep allocating on top of it without touching the file.
+			const int fd = open(path, O_RDONLY);
+			if (fd == -1)
+				return false;
+			void* mapped = mmap(memory, header.dataSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+			close(fd);
+			if (mapped == MAP_FAILED)
+				return false;
+			committed = Max(committed, header.dataSize);
+			front = header.front;
+			maxAlignment = static_cast<uint32_t>(header.maxAlignment);
+			rootOffset = header.rootOffset;
+			return true;
+		}
+#endif
+
+		if (info.virtualMemory && header.front > committed)
+			Commit(*this, header.front);
+		file.seekg(0);
+		file.read(static_cast<char*>(memory), static_cast<std::streamsize>(header.front));
+		if (!file.good())
+			return false;
+		front = header.front;
+		maxAlignment = static_cast<uint32_t>(header.maxAlignment);
+		rootOffset = header.rootOffset;
+		return true;
 	}
 }
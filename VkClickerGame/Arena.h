@@ -1,21 +1,51 @@
 #pragma once
 #include <cstdint>
+#include <cstring>
+#include <type_traits>
 
 namespace jv
 {
 	struct Arena;
+	struct ArenaBlockCache;
+
+	// Usage statistics of an arena. Values prefixed with frame are meant to be reset by the owner every frame.
+	struct ArenaStats final
+	{
+		uint64_t peak = 0;
+		uint64_t framePeak = 0;
+		uint64_t allocations = 0;
+		uint64_t frameAllocations = 0;
+		// Amount of times the arena had to move on to a chained block.
+		uint64_t spills = 0;
+		uint64_t frameSpills = 0;
+		uint32_t scopeDepth = 0;
+		// Deepest the scopes went this frame.
+		uint32_t frameScopeDepth = 0;
+	};
 
 	struct ArenaCreateInfo final
 	{
-		void* (*alloc)(uint32_t size);
+		void* (*alloc)(uint64_t size);
 		void (*free)(void* ptr);
 		void* memory = nullptr;
-		uint32_t memorySize = 4096 * 256 * 32;
+		uint64_t memorySize = 4096 * 256 * 32;
+		// Reserves memorySize as address space and only commits pages as the front advances.
+		// Alloc and free are not used in this mode.
+		bool virtualMemory = false;
+		// Committed memory beyond the front that is kept when the arena rewinds before it is handed back to the OS.
+		uint64_t decommitThreshold = 4096 * 256;
+		// Optional, chained blocks are taken from and handed back to this cache. Not used with virtual memory.
+		ArenaBlockCache* cache = nullptr;
+		// Optional, tracks usage statistics when set. Shared with the chained blocks.
+		ArenaStats* stats = nullptr;
 	};
 
+	// Stored directly behind every allocation. Its size also sets the default alignment of the arena.
 	struct ArenaAllocMetaData final
 	{
-		uint32_t size;
+		uint64_t size : 48;
+		// Bytes skipped in front of the allocation to align it.
+		uint64_t padding : 16;
 	};
 
 	// Handles manual memory allocation.
@@ -24,10 +54,11 @@ namespace jv
 	{
 		struct Scope final
 		{
+			// Fronts are limited to 256 TiB and chains to 65536 blocks, which keeps the handle at 64 bits.
 			struct Unpacked final
 			{
-				uint32_t depth;
-				uint32_t front;
+				uint64_t depth : 16;
+				uint64_t front : 48;
 			};
 
 			union
@@ -36,36 +67,101 @@ namespace jv
 				Unpacked unpacked;
 			};
 		};
+		static_assert(sizeof(Scope) == sizeof(uint64_t), "Scope handles have to fit in 64 bits.");
 
 		ArenaCreateInfo info;
 		void* memory;
-		uint32_t front = 0;
+		uint64_t front = 0;
 		Arena* next = nullptr;
+		// Chained blocks point back to the block before them. Null for the first chained block, since the root can be moved.
+		Arena* prev = nullptr;
+		// Block that currently receives allocations, null when that is the root itself.
+		// Blocks past the tail are considered empty and get reset when the tail moves into them.
+		Arena* tail = nullptr;
+		uint32_t tailDepth = 0;
+		// Scopes created and not yet destroyed. Scopes that are left open are dropped when the arena is cleared.
+		uint32_t openScopes = 0;
+		// Largest alignment handed out since the last clear, which decides how much of the base address snapshots depend on.
+		uint32_t maxAlignment = alignof(ArenaAllocMetaData);
+		// Bytes committed from the start of the block, only used for virtual memory.
+		uint64_t committed = 0;
+		// Bytes in use by the blocks before this one.
+		uint64_t base = 0;
 
 		__declspec(dllexport) [[nodiscard]] static Arena Create(const ArenaCreateInfo& info);
 		__declspec(dllexport) static void Destroy(const Arena& arena);
 
-		__declspec(dllexport) void* Alloc(uint32_t size);
+		__declspec(dllexport) void* Alloc(uint64_t size);
+		// Alignment has to be a power of two up to 65536. Alignments up to that of the metadata are free.
+		__declspec(dllexport) void* AllocAligned(uint64_t size, uint32_t alignment);
 		__declspec(dllexport) void Free(const void* ptr);
+		// Resizes the front allocation in place. Returns false when ptr is not the front allocation or the block is too small.
+		__declspec(dllexport) [[nodiscard]] bool Extend(const void* ptr, uint64_t size);
+		// Whether ptr is the front allocation, which is the only one Free accepts.
+		__declspec(dllexport) [[nodiscard]] bool IsFront(const void* ptr) const;
 		__declspec(dllexport) void Clear();
-		__declspec(dllexport) [[nodiscard]] uint32_t GetTotalUsedMemory() const;
-		__declspec(dllexport) [[nodiscard]] void GetFront(uint32_t& depth, uint32_t& front) const;
+		// Memory allocated for all blocks, used or not.
+		__declspec(dllexport) [[nodiscard]] uint64_t GetTotalUsedMemory() const;
+		// Bytes between the start of the arena and its front, including metadata and padding.
+		__declspec(dllexport) [[nodiscard]] uint64_t GetUsedMemory() const;
+		__declspec(dllexport) [[nodiscard]] void GetFront(uint32_t& depth, uint64_t& front) const;
 
+		// Trivially constructible types are zeroed in one go instead of being constructed one by one.
 		template <typename T>
 		__declspec(dllexport) [[nodiscard]] T* New(size_t count = 1);
+		template <typename T>
+		__declspec(dllexport) [[nodiscard]] T* NewUninit(size_t count = 1);
 
 		// A scope can be used to instantly delete everything that was made after the scope's creation.
-		__declspec(dllexport) [[nodiscard]] uint64_t CreateScope() const;
+		__declspec(dllexport) [[nodiscard]] uint64_t CreateScope();
 		__declspec(dllexport) void DestroyScope(uint64_t handle);
+
+		// Writes the used memory of an unchained arena to a file. Only position independent data survives a reload,
+		// so pointers within the arena should be offsets. The root offset can be used to find the data back after a load.
+		__declspec(dllexport) [[nodiscard]] bool SaveSnapshot(const char* path, uint64_t rootOffset) const;
+		// Loads a snapshot into an empty arena. Virtual memory arenas on Linux map the file instead of reading it,
+		// so pages are only loaded when they are touched. Fails when the arena's memory does not sit at the same offset
+		// from the largest alignment used by the saved arena. Virtual memory arenas always do.
+		__declspec(dllexport) [[nodiscard]] bool LoadSnapshot(const char* path, uint64_t& rootOffset);
+
+	private:
+		[[nodiscard]] static uint32_t GetPadding(const Arena& block, uint32_t alignment);
+		static void Commit(Arena& block, uint64_t front);
+		static void Decommit(Arena& block);
+		// Rewinds and decommits all blocks chained after the given block, for virtual arenas that keep their chain.
+		static void DecommitChain(Arena& block);
+		// Hands all blocks chained after the given block back to the cache.
+		static void ReleaseChain(Arena& block);
+		template <typename T>
+		static void Construct(T* ptr, size_t count, std::true_type);
+		template <typename T>
+		static void Construct(T* ptr, size_t count, std::false_type);
 	};
 
 	template <typename T>
 	T* Arena::New(const size_t count)
 	{
-		void* ptr = Alloc(sizeof(T) * count);
-		T* ptrType = static_cast<T*>(ptr);
-		for (uint32_t i = 0; i < count; ++i)
-			new(&ptrType[i]) T();
-		return ptrType;
+		T* ptr = NewUninit<T>(count);
+		Construct(ptr, count, std::is_trivially_default_constructible<T>());
+		return ptr;
+	}
+
+	template <typename T>
+	T* Arena::NewUninit(const size_t count)
+	{
+		return static_cast<T*>(AllocAligned(sizeof(T) * count, alignof(T)));
+	}
+
+	template <typename T>
+	void Arena::Construct(T* ptr, const size_t count, std::true_type)
+	{
+		memset(ptr, 0, sizeof(T) * count);
+	}
+
+	template <typename T>
+	void Arena::Construct(T* ptr, const size_t count, std::false_type)
+	{
+		for (size_t i = 0; i < count; ++i)
+			new(&ptr[i]) T();
 	}
 }
@@ -0,0 +1,79 @@
+#include "pch.h"
+#include "ArenaBlockCache.h"
+
+namespace jv
+{
+	void ArenaBlockCache::Init(const ArenaBlockCacheCreateInfo& info)
+	{
+		assert(info.free);
+		this->info = info;
+	}
+
+	void ArenaBlockCache::Clear()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		while (_entries)
+		{
+			Entry* next = _entries->next;
+			info.free(_entries);
+			_entries = next;
+		}
+	}
+
+	void* ArenaBlockCache::Acquire(const uint64_t minSize, uint64_t& size)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		Entry** best = nullptr;
+		for (Entry** current = &_entries; *current; current = &(*current)->next)
+			if ((*current)->size >= minSize && (!best || (*current)->size < (*best)->size))
+				best = current;
+		if (!best)
+			return nullptr;
+
+		Entry* entry = *best;
+		*best = entry->next;
+		size = entry->size;
+		return entry;
+	}
+
+	void ArenaBlockCache::Release(void* memory, const uint64_t size)
+	{
+		assert(size >= sizeof(Entry));
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		const auto entry = static_cast<Entry*>(memory);
+		entry->size = size;
+		entry->frame = _frame;
+		entry->next = _entries;
+		_entries = entry;
+	}
+
+	void ArenaBlockCache::Frame()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		++_frame;
+
+		Entry** current = &_entries;
+		while (*current)
+		{
+			Entry* entry = *current;
+			if (_frame - entry->frame <= info.idleFrames)
+			{
+				current = &entry->next;
+				continue;
+			}
+			*current = entry->next;
+			info.free(entry);
+		}
+	}
+
+	uint64_t ArenaBlockCache::GetCachedMemory()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		uint64_t size = 0;
+		for (const Entry* current = _entries; current; current = current->next)
+			size += current->size;
+		return size;
+	}
+}
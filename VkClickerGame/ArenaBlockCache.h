@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+
+namespace jv
+{
+	struct ArenaBlockCacheCreateInfo final
+	{
+		void (*free)(void* ptr);
+		// Cached blocks that have not been reused for this many frames are freed.
+		uint32_t idleFrames = 120;
+	};
+
+	// Keeps the blocks that arenas chain when they overflow, so that the next overflow can reuse them instead of allocating.
+	// Thread safe, since the arenas of worker threads share it.
+	struct ArenaBlockCache final
+	{
+		ArenaBlockCacheCreateInfo info;
+
+		__declspec(dllexport) void Init(const ArenaBlockCacheCreateInfo& info);
+		// Frees all cached blocks.
+		__declspec(dllexport) void Clear();
+
+		// Returns the smallest cached block of at least minSize, or null if there is none.
+		__declspec(dllexport) [[nodiscard]] void* Acquire(uint64_t minSize, uint64_t& size);
+		__declspec(dllexport) void Release(void* memory, uint64_t size);
+		// Advances the frame and frees the blocks that have been idle for too long.
+		__declspec(dllexport) void Frame();
+		__declspec(dllexport) [[nodiscard]] uint64_t GetCachedMemory();
+
+	private:
+		// Stored at the start of the cached block itself.
+		struct Entry final
+		{
+			uint64_t size;
+			uint64_t frame;
+			Entry* next;
+		};
+
+		std::mutex _mutex{};
+		Entry* _entries = nullptr;
+		uint64_t _frame = 0;
+	};
+}
@@ -1,14 +1,18 @@
 #pragma once
 #include "mem.h"
 #include "Link.h"
+#include "Sort.h"
+#include "Simd.h"
 
 namespace mem
 {
+	// Lengths are 32 bit, so anything larger has to be allocated through alloc and split up.
 	template <typename T>
 	struct Arr
 	{
 		Arr();
 		Arr(uint8_t arena, uint32_t length);
+		Arr(uint8_t arena, uint32_t length, Uninit);
 		Arr(T* ptr, uint32_t i);
 		T& operator[](uint32_t i) const;
 		uint32_t length() const;
@@ -22,9 +26,16 @@ namespace mem
 		Arr<T> first(uint32_t length);
 		Arr<T> last(uint32_t length);
 		Arr<T> part(uint32_t i, uint32_t length);
+		// Integers, enums, pointers, floats and doubles use vectorized kernels, other types a plain loop.
 		void set(T value);
+		// Returns the index of the first element equal to value, or -1.
 		int32_t contains(T value);
 		void fill(T value);
+		uint32_t countOf(T value) const;
+		// Min and max need at least one element. The sum of an empty array is T().
+		T min() const;
+		T max() const;
+		T sum() const;
 
 		template <typename U>
 		void iter(U func, bool reverse = false) const;
@@ -32,10 +43,27 @@ namespace mem
 		void iter(U func, const Arr<T>& other);
 		template <typename U>
 		bool iterb(U func, bool reverse = false) const;
+		// Returns the elements func returns true for, in their original order.
 		template <typename U>
 		Arr<T> get(uint8_t arena, U func) const;
+		// Moves the elements func returns false for to the front, keeping their order, and shrinks the array to them.
+		// Returns the new length.
+		template <typename U>
+		uint32_t removeIf(U func);
+		// Func returns whether a goes before b. Not stable.
 		template <typename U>
 		void sort(U func) const;
+		// KeyFunc returns the key of an element as an integer, an enum, a float or a double. Sorts ascending and is stable.
+		// Faster than sort for large arrays, but only works on trivially copyable types. Uses TEMP for scratch memory.
+		template <typename U>
+		void radixSort(U keyFunc) const;
+		template <typename U>
+		void radixExtSort(uint32_t* indices, U keyFunc) const;
+		// Splits the sort over the thread pool when the array holds at least threshold elements.
+		// Only works on trivially copyable types, and func has to be safe to call from multiple threads.
+		// Can not be called from a thread pool task, since it waits for tasks of its own.
+		template <typename U>
+		void parallelSort(U func, uint32_t threshold = 100000) const;
 		uint32_t* makeExtSort(uint8_t arena) const;
 		template <typename U>
 		void extSort(uint32_t* indices, U func) const;
@@ -46,6 +74,12 @@ namespace mem
 	protected:
 		T* _ptr = nullptr;
 		uint32_t _length = 0;
+
+	private:
+		template <typename U>
+		uint32_t _removeIf(U& func, std::true_type);
+		template <typename U>
+		uint32_t _removeIf(U& func, std::false_type);
 	};
 
 	template<typename T>
@@ -60,6 +94,12 @@ namespace mem
 		_length = length;
 	}
 	template<typename T>
+	inline Arr<T>::Arr(uint8_t arena, uint32_t length, Uninit)
+	{
+		_ptr = mem::allocUninit<T>(arena, length);
+		_length = length;
+	}
+	template<typename T>
 	inline Arr<T>::Arr(T* ptr, uint32_t i)
 	{
 		point(ptr, i);
@@ -88,7 +128,7 @@ namespace mem
 		assert(to > -(int32_t)_length || to == -1);
 		uint32_t uto = to >= 0 ? to : _length - abs(to + 1);
 		uint32_t l = uto - from;
-		auto oArr = Arr<T>(arena, l);
+		auto oArr = Arr<T>(arena, l, uninit);
 		memcpy(oArr.ptr(), &_ptr[from], sizeof(T) * l);
 		return oArr;
 	}
@@ -147,27 +187,44 @@ namespace mem
 	template<typename T>
 	inline void Arr<T>::set(T value)
 	{
-		for (uint32_t i = 0; i < _length; i++)
-			_ptr[i] = value;
+		fill(value);
 	}
 	template<typename T>
 	inline int32_t Arr<T>::contains(T value)
 	{
-		for (uint32_t i = 0; i < _length; i++)
-			if (_ptr[i] == value)
-				return i;
-		return -1;
+		return static_cast<int32_t>(p_find(_ptr, _length, value, p_SimdElement<T>()));
 	}
 	template<typename T>
 	inline void Arr<T>::fill(T value)
 	{
-		for (uint32_t i = 0; i < _length; i++)
-			_ptr[i] = value;
+		p_fill(_ptr, _length, value, p_SimdElement<T>());
+	}
+	template<typename T>
+	inline uint32_t Arr<T>::countOf(T value) const
+	{
+		return static_cast<uint32_t>(p_count(_ptr, _length, value, p_SimdElement<T>()));
+	}
+	template<typename T>
+	inline T Arr<T>::min() const
+	{
+		assert(_length > 0);
+		return p_min(_ptr, _length);
+	}
+	template<typename T>
+	inline T Arr<T>::max() const
+	{
+		assert(_length > 0);
+		return p_max(_ptr, _length);
+	}
+	template<typename T>
+	inline T Arr<T>::sum() const
+	{
+		return p_sum(_ptr, _length);
 	}
 	template<typename T>
 	inline uint32_t* Arr<T>::makeExtSort(uint8_t arena) const
 	{
-		auto arr = mem::Arr<uint32_t>(arena, _length);
+		auto arr = mem::Arr<uint32_t>(arena, _length, uninit);
 		arr.iter([](auto& v, auto i)
 			{
 				v = i;
@@ -177,7 +234,7 @@ namespace mem
 	template<typename T>
 	inline Arr<T> Arr<T>::combine(uint8_t arena, Arr<T>& a, Arr<T>& b)
 	{
-		auto arr = Arr<T>(arena, a.length() + b.length());
+		auto arr = Arr<T>(arena, a.length() + b.length(), uninit);
 		memcpy(arr._ptr, a._ptr, a._length * sizeof(T));
 		memcpy(&arr._ptr[a._length], b._ptr, b._length * sizeof(T));
 		return arr;
@@ -225,58 +282,115 @@ namespace mem
 	template<typename U>
 	inline Arr<T> Arr<T>::get(uint8_t arena, U func) const
 	{
-		auto _ = arena == FRAM ? mem::manualScope(FRAM) : mem::scope(FRAM);
-		auto link = Link<T>();
+		// Func is evaluated once into a mask, so the result can be allocated at its final size before it is written.
+		const ARENA scratch = arena == TEMP ? FRAM : TEMP;
+		auto _ = mem::scope(scratch);
+		// Stores to the mask can alias the members, so they are read into locals for the loop to vectorize.
+		T* ptr = _ptr;
+		const uint32_t length = _length;
+		auto keep = mem::allocUninit<uint8_t>(scratch, length);
+		uint32_t count = 0;
+		for (uint32_t i = 0; i < length; i++)
+		{
+			const uint8_t k = func(ptr[i], i) ? 1 : 0;
+			keep[i] = k;
+			count += k;
+		}
+
+		constexpr bool pod = std::is_trivially_copyable<T>::value;
+		auto arr = pod ? Arr<T>(arena, count, uninit) : Arr<T>(arena, count);
+		const uint32_t n = p_compress(arr._ptr, ptr, keep, length, count, std::integral_constant<bool, pod>());
+		assert(n == count);
+		return arr;
+	}
+	template<typename T>
+	template<typename U>
+	inline uint32_t Arr<T>::removeIf(U func)
+	{
+		_length = _removeIf(func, std::is_trivially_copyable<T>());
+		return _length;
+	}
+	template<typename T>
+	template<typename U>
+	inline uint32_t Arr<T>::_removeIf(U& func, std::true_type)
+	{
+		// The mask is filled in blocks on the stack, and every block is compacted right after.
+		// The writes never pass the block that is being read, so it works in place.
+		constexpr uint32_t block = 256;
+		uint8_t keep[block];
+		T* ptr = _ptr;
+		const uint32_t total = _length;
+		uint32_t n = 0;
+		for (uint32_t i = 0; i < total; i += block)
+		{
+			const uint32_t length = total - i < block ? total - i : block;
+			for (uint32_t j = 0; j < length; j++)
+				keep[j] = func(ptr[i + j], i + j) ? 0 : 1;
+			n += p_compress(&ptr[n], &ptr[i], keep, length, length, std::true_type());
+		}
+		return n;
+	}
+	template<typename T>
+	template<typename U>
+	inline uint32_t Arr<T>::_removeIf(U& func, std::false_type)
+	{
+		uint32_t n = 0;
 		for (uint32_t i = 0; i < _length; i++)
+		{
 			if (func(_ptr[i], i))
-				link.add(FRAM) = _ptr[i];
-		return link.arr(arena);
+				continue;
+			if (n != i)
+				_ptr[n] = std::move(_ptr[i]);
+			n++;
+		}
+		return n;
 	}
 	template<typename T>
 	template<typename U>
 	inline void Arr<T>::sort(U func) const
 	{
-		for (size_t i = 1; i < _length; ++i)
-		{
-			size_t idx = i;
-			while (idx > 0)
-			{
-				auto& current = _ptr[idx];
-				auto& other = _ptr[idx - 1];
-
-				if (!func(current, other))
-					break;
-
-				T temp = current;
-				current = other;
-				other = temp;
-
-				--idx;
-			}
-		}
+		p_sort(_ptr, _length, func);
 	}
 	template<typename T>
 	template<typename U>
 	inline void Arr<T>::extSort(uint32_t* indices, U func) const
 	{
-		for (size_t i = 1; i < _length; ++i)
-		{
-			size_t idx = i;
-			while (idx > 0)
+		T* ptr = _ptr;
+		p_sort(indices, _length, [ptr, &func](const uint32_t a, const uint32_t b)
 			{
-				auto& current = _ptr[indices[idx]];
-				auto& other = _ptr[indices[idx - 1]];
-
-				if (!func(current, other))
-					break;
+				return func(ptr[a], ptr[b]);
+			});
+	}
+	template<typename T>
+	template<typename U>
+	inline void Arr<T>::parallelSort(U func, uint32_t threshold) const
+	{
+		p_parallelSort(_ptr, _length, func, threshold);
+	}
+	template<typename T>
+	template<typename U>
+	inline void Arr<T>::radixSort(U keyFunc) const
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Radix sort moves elements with plain copies, use radixExtSort instead.");
+		using K = decltype(p_radixKey(keyFunc(_ptr[0])));
 
-				const auto temp = indices[idx];
-				indices[idx] = indices[idx - 1];
-				indices[idx - 1] = temp;
+		auto _ = mem::scope(TEMP);
+		auto keys = mem::allocUninit<K>(TEMP, _length);
+		for (uint32_t i = 0; i < _length; i++)
+			keys[i] = p_radixKey(keyFunc(_ptr[i]));
+		p_radixSort(keys, _ptr, _length, TEMP);
+	}
+	template<typename T>
+	template<typename U>
+	inline void Arr<T>::radixExtSort(uint32_t* indices, U keyFunc) const
+	{
+		using K = decltype(p_radixKey(keyFunc(_ptr[0])));
 
-				--idx;
-			}
-		}
+		auto _ = mem::scope(TEMP);
+		auto keys = mem::allocUninit<K>(TEMP, _length);
+		for (uint32_t i = 0; i < _length; i++)
+			keys[i] = p_radixKey(keyFunc(_ptr[indices[i]]));
+		p_radixSort(keys, indices, _length, TEMP);
 	}
 	template<typename T>
 	inline void Arr<T>::applyExtSort(uint32_t* indices, uint8_t t) const
@@ -0,0 +1,100 @@
+#include "pch.h"
+#include "ConcurrentArena.h"
+#include "Math.h"
+
+namespace jv
+{
+	// Keeps the start of the usable memory aligned to the largest fundamental alignment.
+	constexpr uint64_t BLOCK_HEADER_SIZE = (sizeof(ConcurrentArena::Block) + 15) & ~15ull;
+
+	ConcurrentArena ConcurrentArena::Create(const ArenaCreateInfo& info)
+	{
+		assert(info.memorySize > BLOCK_HEADER_SIZE);
+		assert(info.alloc);
+		assert(info.free);
+		assert(!info.memory);
+
+		ConcurrentArena arena{};
+		arena.info = info;
+		arena.root = CreateBlock(info, info.memorySize);
+		arena.tail = static_cast<std::atomic<Block*>*>(info.alloc(sizeof(std::atomic<Block*>)));
+		new(arena.tail) std::atomic<Block*>(arena.root);
+		return arena;
+	}
+
+	void ConcurrentArena::Destroy(const ConcurrentArena& arena)
+	{
+		Block* current = arena.root;
+		while (current)
+		{
+			Block* next = current->next.load(std::memory_order_relaxed);
+			arena.info.free(current);
+			current = next;
+		}
+		arena.info.free(arena.tail);
+	}
+
+	void* ConcurrentArena::Alloc(uint64_t size, const uint32_t alignment)
+	{
+		assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+		size = (size + 7) & ~7ull;
+		// Reserve enough to be able to align the pointer afterwards, fronts are always 8 byte aligned.
+		const uint64_t reserved = size + (alignment > 8 ? alignment - 8 : 0);
+
+		while (true)
+		{
+			Block* block = tail->load(std::memory_order_acquire);
+			const uint64_t front = block->front.fetch_add(reserved, std::memory_order_relaxed);
+			if (front + reserved <= block->size)
+			{
+				const auto address = reinterpret_cast<uintptr_t>(block) + BLOCK_HEADER_SIZE + front;
+				return reinterpret_cast<void*>((address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1));
+			}
+
+			// The block is full. Whoever links the next block first wins, the others hand theirs back.
+			Block* next = block->next.load(std::memory_order_acquire);
+			if (!next)
+			{
+				Block* created = CreateBlock(info, Max<uint64_t>(info.memorySize, reserved + BLOCK_HEADER_SIZE));
+				if (block->next.compare_exchange_strong(next, created, std::memory_order_acq_rel))
+					next = created;
+				else
+					info.free(created);
+			}
+
+			// Can fail when another thread already moved the tail, which is fine.
+			tail->compare_exchange_strong(block, next, std::memory_order_acq_rel);
+		}
+	}
+
+	void ConcurrentArena::Clear()
+	{
+		Block* current = root;
+		while (current)
+		{
+			current->front.store(0, std::memory_order_relaxed);
+			current = current->next.load(std::memory_order_relaxed);
+		}
+		tail->store(root, std::memory_order_release);
+	}
+
+	uint64_t ConcurrentArena::GetTotalUsedMemory() const
+	{
+		uint64_t size = 0;
+		const Block* current = root;
+		while (current)
+		{
+			size += current->size + BLOCK_HEADER_SIZE;
+			current = current->next.load(std::memory_order_relaxed);
+		}
+		return size;
+	}
+
+	ConcurrentArena::Block* ConcurrentArena::CreateBlock(const ArenaCreateInfo& info, const uint64_t size)
+	{
+		void* memory = info.alloc(size);
+		const auto block = new(memory) Block();
+		block->size = size - BLOCK_HEADER_SIZE;
+		return block;
+	}
+}
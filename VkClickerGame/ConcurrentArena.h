@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <atomic>
+#include "Arena.h"
+
+namespace jv
+{
+	// Linear allocator that can be shared between threads.
+	// Allocations are a single atomic add on the front of the current block, which chains to a new block when it overflows.
+	// Individual frees and scopes are not supported, memory is only reclaimed by Clear.
+	struct ConcurrentArena final
+	{
+		struct Block final
+		{
+			std::atomic<uint64_t> front{ 0 };
+			std::atomic<Block*> next{ nullptr };
+			uint64_t size;
+		};
+
+		ArenaCreateInfo info;
+		Block* root = nullptr;
+		// Stored outside the struct so the arena itself stays copyable.
+		std::atomic<Block*>* tail = nullptr;
+
+		__declspec(dllexport) [[nodiscard]] static ConcurrentArena Create(const ArenaCreateInfo& info);
+		__declspec(dllexport) static void Destroy(const ConcurrentArena& arena);
+
+		// Alignment has to be a power of two. Thread safe.
+		__declspec(dllexport) void* Alloc(uint64_t size, uint32_t alignment = 8);
+		// Not thread safe, keeps the chained blocks around for reuse.
+		__declspec(dllexport) void Clear();
+		__declspec(dllexport) [[nodiscard]] uint64_t GetTotalUsedMemory() const;
+
+	private:
+		[[nodiscard]] static Block* CreateBlock(const ArenaCreateInfo& info, uint64_t size);
+	};
+}
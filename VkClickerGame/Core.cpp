@@ -86,6 +86,7 @@ namespace gr
         struct Rateable {
             VkPhysicalDevice device;
             uint32_t rating = 0;
+            uint32_t index = 0;
         };
 
         auto _ = mem::scope(TEMP);
@@ -97,6 +98,7 @@ namespace gr
         devices.iter([&rateables](auto& device, auto i) {
             auto& r = rateables.add() = {};
             r.device = device;
+            r.index = i;
             });
 
         uint32_t extensionCount = 0;
@@ -161,9 +163,11 @@ namespace gr
             rateable.rating += static_cast<uint32_t>(localHeapSize / (1024 * 1024 * 1024)); // GB
         }
 
-        // Sort by rating.
+        // Sort by rating. Sort is not stable, so ties go to the device that was enumerated first.
         rateables.sort([](Rateable& a, Rateable& b) {
-            return a.rating > b.rating;
+            if (a.rating != b.rating)
+                return a.rating > b.rating;
+            return a.index < b.index;
             });
         _core.physicalDevice = rateables[0].device;
 	}
@@ -9,9 +9,9 @@ namespace gr {
 	}
 	void DescriptorSetLayoutManager::OnScopeClear()
 	{
-		auto _ = mem::scope(TEMP);
-		auto arr = _sets.arr(TEMP);
-		for (int32_t i = arr.length() - 1; i >= 0; i--)
-			vkDestroyDescriptorSetLayout(_core->device, arr[i].layout, nullptr);
+		_sets.iter([this](Set& set, uint32_t)
+			{
+				vkDestroyDescriptorSetLayout(_core->device, set.layout, nullptr);
+			});
 	}
 }
\ No newline at end of file
@@ -9,9 +9,11 @@ namespace mem
 		std::ifstream file(path, std::ios::ate | std::ios::binary);
 		assert(file.is_open());
 
-		// Dump contents in the buffer.
+		// Dump contents in the buffer, which can not hold files of 4 GiB or more.
 		const size_t fileSize = file.tellg();
-		const auto buffer = mem::Arr<char>(arena, fileSize);
+		if (fileSize > UINT32_MAX)
+			throw std::exception("File too large to load into an array.");
+		const auto buffer = mem::Arr<char>(arena, static_cast<uint32_t>(fileSize), mem::uninit);
 
 		file.seekg(0);
 		file.read(buffer.ptr(), static_cast<std::streamsize>(fileSize));
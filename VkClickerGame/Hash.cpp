@@ -0,0 +1,65 @@
+#include "pch.h"
+#include "Hash.h"
+
+namespace mem
+{
+	uint64_t hashMix(uint64_t key)
+	{
+		// Finalizer of MurmurHash3.
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdULL;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ULL;
+		key ^= key >> 33;
+		return key;
+	}
+	uint64_t hashBytes(const void* data, const size_t size, const uint64_t seed)
+	{
+		// MurmurHash64A.
+		constexpr uint64_t m = 0xc6a4a7935bd1e995ULL;
+		constexpr int r = 47;
+
+		const auto bytes = static_cast<const uint8_t*>(data);
+		uint64_t h = seed ^ (size * m);
+
+		const size_t blocks = size / 8;
+		for (size_t i = 0; i < blocks; i++)
+		{
+			uint64_t k;
+			memcpy(&k, &bytes[i * 8], sizeof k);
+			k *= m;
+			k ^= k >> r;
+			k *= m;
+			h ^= k;
+			h *= m;
+		}
+
+		const uint8_t* tail = &bytes[blocks * 8];
+		const size_t rest = size & 7;
+		if (rest > 0)
+		{
+			uint64_t k = 0;
+			for (size_t i = 0; i < rest; i++)
+				k |= static_cast<uint64_t>(tail[i]) << (i * 8);
+			h ^= k;
+			h *= m;
+		}
+
+		h ^= h >> r;
+		h *= m;
+		h ^= h >> r;
+		return h;
+	}
+	uint64_t hashCombine(const uint64_t seed, const uint64_t hash)
+	{
+		return hashMix(seed ^ (hash + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+	}
+	uint64_t Hash<Str>::hash(const Str& key)
+	{
+		return hashBytes(key.ptr(), strlen(key.ptr()));
+	}
+	bool Hash<Str>::equal(const Str& a, const Str& b)
+	{
+		return strcmp(a.ptr(), b.ptr()) == 0;
+	}
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace mem
+{
+	struct Str;
+	template <typename T>
+	struct Arr;
+
+	// Picks the first overload for types built on Arr, which only point to their elements.
+	template <typename T>
+	std::true_type p_isArr(const Arr<T>*);
+	std::false_type p_isArr(const void*);
+
+	// Spreads every bit of the key over the whole hash.
+	[[nodiscard]] uint64_t hashMix(uint64_t key);
+	// Fast non-cryptographic hash over raw bytes, processing 8 bytes at a time.
+	[[nodiscard]] uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+	[[nodiscard]] uint64_t hashCombine(uint64_t seed, uint64_t hash);
+
+	// Hashes and compares keys for Map and Set. Can be specialized for custom key types, or passed as a separate hasher.
+	// The default treats keys as plain bytes, which only works for structs without padding.
+	template <typename T, typename Enable = void>
+	struct Hash final {
+		static_assert(std::is_trivially_copyable<T>::value, "Key has to be trivially copyable to be hashed as bytes.");
+		static_assert(!decltype(p_isArr(static_cast<T*>(nullptr)))::value, "Key only points to its elements, use its arr() as the key instead.");
+		[[nodiscard]] static uint64_t hash(const T& key);
+		[[nodiscard]] static bool equal(const T& a, const T& b);
+	};
+
+	template <typename T>
+	struct Hash<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type> final {
+		[[nodiscard]] static uint64_t hash(const T& key);
+		[[nodiscard]] static bool equal(const T& a, const T& b);
+	};
+
+	template <typename T>
+	struct Hash<T*> final {
+		[[nodiscard]] static uint64_t hash(T* key);
+		[[nodiscard]] static bool equal(T* a, T* b);
+	};
+
+	// Hashes the characters up to the null terminator, so strings with different capacities can match.
+	template <>
+	struct Hash<Str> final {
+		[[nodiscard]] static uint64_t hash(const Str& key);
+		[[nodiscard]] static bool equal(const Str& a, const Str& b);
+	};
+
+	// Hashes the elements instead of the pointer, so arrays with the same contents match wherever they are stored.
+	template <typename T>
+	struct Hash<Arr<T>> final {
+		static_assert(std::is_trivially_copyable<T>::value, "Elements have to be trivially copyable to be hashed as bytes.");
+		[[nodiscard]] static uint64_t hash(const Arr<T>& key);
+		[[nodiscard]] static bool equal(const Arr<T>& a, const Arr<T>& b);
+	};
+
+	// Combines the hashes of every field, for structs that have padding or hold pointers.
+	template <typename T>
+	[[nodiscard]] uint64_t hashFields(const T& field);
+	template <typename T, typename ...Args>
+	[[nodiscard]] uint64_t hashFields(const T& field, const Args&... fields);
+
+	template <typename T, typename Enable>
+	inline uint64_t Hash<T, Enable>::hash(const T& key)
+	{
+		return hashBytes(&key, sizeof(T));
+	}
+	template <typename T, typename Enable>
+	inline bool Hash<T, Enable>::equal(const T& a, const T& b)
+	{
+		return memcmp(&a, &b, sizeof(T)) == 0;
+	}
+	template <typename T>
+	inline uint64_t Hash<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type>::hash(const T& key)
+	{
+		return hashMix(static_cast<uint64_t>(key));
+	}
+	template <typename T>
+	inline bool Hash<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type>::equal(const T& a, const T& b)
+	{
+		return a == b;
+	}
+	template <typename T>
+	inline uint64_t Hash<T*>::hash(T* key)
+	{
+		return hashMix(reinterpret_cast<uintptr_t>(key));
+	}
+	template <typename T>
+	inline bool Hash<T*>::equal(T* a, T* b)
+	{
+		return a == b;
+	}
+	template <typename T>
+	inline uint64_t Hash<Arr<T>>::hash(const Arr<T>& key)
+	{
+		return hashBytes(key.ptr(), sizeof(T) * key.length());
+	}
+	template <typename T>
+	inline bool Hash<Arr<T>>::equal(const Arr<T>& a, const Arr<T>& b)
+	{
+		return a.length() == b.length() && (a.length() == 0 || memcmp(a.ptr(), b.ptr(), sizeof(T) * a.length()) == 0);
+	}
+	template <typename T>
+	inline uint64_t hashFields(const T& field)
+	{
+		return Hash<T>::hash(field);
+	}
+	template <typename T, typename ...Args>
+	inline uint64_t hashFields(const T& field, const Args&... fields)
+	{
+		return hashCombine(Hash<T>::hash(field), hashFields(fields...));
+	}
+}
@@ -2,10 +2,10 @@
 
 namespace mem
 {
-	template <typename T>
+	template <typename T, typename K = size_t>
 	struct KeyPair final
 	{
 		T value{};
-		size_t key = SIZE_MAX;
+		K key{};
 	};
 }
\ No newline at end of file
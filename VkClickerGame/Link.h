@@ -6,6 +6,8 @@ namespace mem
 	template <typename T>
 	struct Arr;
 
+	// Append only list that stores its elements in arena chunks, in the order they were added.
+	// Elements never move, so references returned by add stay valid.
 	template <typename T>
 	struct Link final
 	{
@@ -13,47 +15,88 @@ namespace mem
 		uint32_t length() const;
 		Arr<T> arr(uint8_t arena) const;
 
+		template <typename U>
+		void iter(U func) const;
+
 	private:
-		struct Node final
+		// Chunks of about 1 KiB, but no fewer than 16 and no more than 64 elements.
+		static constexpr uint32_t CHUNK_LENGTH = sizeof(T) * 64 <= 1024 ? 64 : sizeof(T) * 16 >= 1024 ? 16 : 1024 / sizeof(T);
+
+		struct Chunk final
 		{
-			T value;
-			Node* next;
+			Chunk* next;
+			T values[CHUNK_LENGTH];
 		};
 
-		Node* _next = nullptr;
+		Chunk* _first = nullptr;
+		Chunk* _last = nullptr;
+		uint32_t _length = 0;
+		uint32_t _lastLength = 0;
+
+		static void _copy(T* dst, const T* src, uint32_t length, std::true_type);
+		static void _copy(T* dst, const T* src, uint32_t length, std::false_type);
 	};
 	template<typename T>
+	constexpr uint32_t Link<T>::CHUNK_LENGTH;
+	template<typename T>
 	inline T& Link<T>::add(uint8_t arena)
 	{
-		auto ptr = mem::alloc<Node>(arena);
-		ptr->value = {};
-		ptr->next = _next;
-		_next = ptr;
-		return ptr->value;
+		if (!_last || _lastLength == CHUNK_LENGTH)
+		{
+			// Elements are constructed one at a time as they are added.
+			auto chunk = mem::allocUninit<Chunk>(arena);
+			chunk->next = nullptr;
+			if (_last)
+				_last->next = chunk;
+			else
+				_first = chunk;
+			_last = chunk;
+			_lastLength = 0;
+		}
+
+		++_length;
+		return *new(&_last->values[_lastLength++]) T();
 	}
 	template<typename T>
 	inline uint32_t Link<T>::length() const
 	{
-		auto next = _next;
-		uint32_t n = 0;
-		while (next)
-		{
-			++n;
-			next = next->next;
-		}
-		return n;
+		return _length;
 	}
 	template<typename T>
 	inline Arr<T> Link<T>::arr(uint8_t arena) const
 	{
-		auto arr = Arr<T>(arena, length());
-		auto next = _next;
+		constexpr bool pod = std::is_trivially_copyable<T>::value;
+		auto arr = pod ? Arr<T>(arena, _length, uninit) : Arr<T>(arena, _length);
 		uint32_t i = 0;
-		while (next)
+		for (auto chunk = _first; chunk; chunk = chunk->next)
 		{
-			arr[i++] = next->value;
-			next = next->next;
+			const uint32_t length = chunk == _last ? _lastLength : CHUNK_LENGTH;
+			_copy(&arr.ptr()[i], chunk->values, length, std::integral_constant<bool, pod>());
+			i += length;
 		}
 		return arr;
 	}
+	template<typename T>
+	template<typename U>
+	inline void Link<T>::iter(U func) const
+	{
+		uint32_t i = 0;
+		for (auto chunk = _first; chunk; chunk = chunk->next)
+		{
+			const uint32_t length = chunk == _last ? _lastLength : CHUNK_LENGTH;
+			for (uint32_t j = 0; j < length; j++)
+				func(chunk->values[j], i++);
+		}
+	}
+	template<typename T>
+	inline void Link<T>::_copy(T* dst, const T* src, uint32_t length, std::true_type)
+	{
+		memcpy(dst, src, sizeof(T) * length);
+	}
+	template<typename T>
+	inline void Link<T>::_copy(T* dst, const T* src, uint32_t length, std::false_type)
+	{
+		for (uint32_t i = 0; i < length; i++)
+			dst[i] = src[i];
+	}
 }
\ No newline at end of file
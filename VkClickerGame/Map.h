@@ -1,120 +1,307 @@
 #pragma once
 #include "Arr.h"
 #include "KeyPair.h"
+#include "Hash.h"
+#include <utility>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MEM_MAP_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-namespace mem 
+namespace mem
 {
-	template <typename T>
-	struct Map final : Arr<KeyPair<T>>
+	// Open addressing hash map that keeps one control byte per slot next to the slots themselves.
+	// Control bytes hold 7 bits of the hash of a full slot, so a lookup compares 16 slots at once and only checks the keys
+	// of slots that match. Probing stops at the first group with an empty slot, which keeps misses O(1).
+	// Grows into a table twice the size when it fills up. The old table is freed on TLSF arenas, and stays in use on linear
+	// arenas until their scope is cleared. When most used slots are deleted ones, they are cleared out in place instead.
+	// Keys are copied into the map as they are, so keys that point to memory (like Str) need that memory to outlive the map.
+	template <typename T, typename K = uint64_t, typename H = Hash<K>>
+	struct Map final
 	{
+		Map();
 		Map(uint8_t arena, uint32_t length);
-		T& operator[](uint64_t key) const;
-		T& insert(uint64_t key);
-		[[nodiscard]] T* contains(uint64_t key) const;
+		T& operator[](const K& key) const;
+		T& insert(const K& key);
+		[[nodiscard]] T* contains(const K& key) const;
+		// Value has to be a reference returned by this map.
 		void erase(T& value);
 		uint32_t count();
+		template <typename U>
+		void iter(U func) const;
 
 	private:
+		static constexpr int8_t EMPTY = -128;
+		static constexpr int8_t DELETED = -2;
+		static constexpr uint32_t GROUP_SIZE = 16;
+
+		uint8_t _arena = NONE;
+		int8_t* _ctrl = nullptr;
+		KeyPair<T, K>* _slots = nullptr;
+		// Always a power of two, and at least the group size.
+		uint32_t _capacity = 0;
 		uint32_t _count = 0;
+		// Slots that can still be taken before a rehash, deleted slots do not count as free.
+		uint32_t _growthLeft = 0;
 
-		[[nodiscard]] uint64_t _hash(uint64_t key) const;
+		[[nodiscard]] static uint32_t _match(const int8_t* group, int8_t value);
+		[[nodiscard]] static uint32_t _matchEmpty(const int8_t* group);
+		[[nodiscard]] static uint32_t _matchFree(const int8_t* group);
+		[[nodiscard]] static uint32_t _lowestBit(uint32_t mask);
+		[[nodiscard]] int64_t _find(const K& key, uint64_t hash) const;
+		[[nodiscard]] uint32_t _findFree(uint64_t hash) const;
+		void _allocate(uint32_t capacity);
+		void _rehash(uint32_t capacity);
+		void _dropDeleted();
 	};
-	template<typename T>
-	inline Map<T>::Map(uint8_t arena, uint32_t length) : Arr<KeyPair<T>>(arena, length)
+	template<typename T, typename K, typename H>
+	inline Map<T, K, H>::Map()
+	{
+	}
+	template<typename T, typename K, typename H>
+	inline Map<T, K, H>::Map(uint8_t arena, uint32_t length) : _arena(arena)
 	{
+		// Keeps the load factor below 7/8 for the requested length.
+		const uint64_t minCapacity = static_cast<uint64_t>(length) * 8 / 7 + 1;
+		uint32_t capacity = GROUP_SIZE;
+		while (capacity < minCapacity)
+			capacity *= 2;
+		_allocate(capacity);
 	}
-	template<typename T>
-	inline T& Map<T>::operator[](uint64_t key) const
+	template<typename T, typename K, typename H>
+	inline T& Map<T, K, H>::operator[](const K& key) const
 	{
 		return *contains(key);
 	}
-	template<typename T>
-	inline T& Map<T>::insert(uint64_t key)
+	template<typename T, typename K, typename H>
+	inline T& Map<T, K, H>::insert(const K& key)
 	{
-		assert(_count < Arr<KeyPair<T>>::_length);
+		assert(_capacity > 0);
+		const uint64_t hash = H::hash(key);
 
 		// If it already contains this value, replace the old one with the newer value.
-		if (auto value = contains(key))
-			return *value;
+		const int64_t found = _find(key, hash);
+		if (found != -1)
+			return _slots[found].value;
 
-		const uint64_t hash = _hash(key);
-
-		for (uint64_t i = 0; i < Arr<KeyPair<T>>::_length; ++i)
+		uint32_t index = _findFree(hash);
+		// Deleted slots can be reused without using up the growth budget.
+		if (_growthLeft == 0 && _ctrl[index] != DELETED)
 		{
-			const uint64_t index = (hash + i) % Arr<KeyPair<T>>::_length;
-			auto& keyPair = Arr<KeyPair<T>>::_ptr[index];
-			// Set to true the first time the key group has been found.
-			if (keyPair.key != SIZE_MAX)
-				continue;
+			// Keeping the capacity is enough when at least half of the used slots are deleted ones.
+			if (_count * 16 <= _capacity * 7)
+				_dropDeleted();
+			else
+				_rehash(_capacity * 2);
+			index = _findFree(hash);
+		}
 
-			keyPair.key = key;
-			++_count;
+		if (_ctrl[index] == EMPTY)
+			--_growthLeft;
+		_ctrl[index] = static_cast<int8_t>(hash & 0x7F);
+		++_count;
 
-			return keyPair.value;
-		}
-		// Should not get here.
-		assert(false);
-		T t;
-		return t;
+		auto& keyPair = _slots[index];
+		new(&keyPair.key) K(key);
+		new(&keyPair.value) T();
+		return keyPair.value;
 	}
-	template<typename T>
-	inline T* Map<T>::contains(uint64_t key) const
+	template<typename T, typename K, typename H>
+	inline T* Map<T, K, H>::contains(const K& key) const
 	{
-		assert(_count <= Arr<KeyPair<T>>::_length);
-
-		// Get and use the hash as an index.
-		const uint64_t hash = _hash(key);
+		const int64_t index = _find(key, H::hash(key));
+		return index == -1 ? nullptr : &_slots[index].value;
+	}
+	template<typename T, typename K, typename H>
+	inline void Map<T, K, H>::erase(T& value)
+	{
+		assert(_count > 0);
+		const auto offset = reinterpret_cast<char*>(&value) - reinterpret_cast<char*>(&_slots[0].value);
+		const uint32_t index = static_cast<uint32_t>(offset / static_cast<int64_t>(sizeof(KeyPair<T, K>)));
+		assert(index < _capacity && _ctrl[index] >= 0);
 
-		for (uint64_t i = 0; i < Arr<KeyPair<T>>::_length; ++i)
+		// A group that never filled up can not have caused a probe to continue past it, so the slot can be emptied.
+		const int8_t* group = &_ctrl[index & ~(GROUP_SIZE - 1)];
+		if (_matchEmpty(group))
 		{
-			const uint64_t index = (hash + i) % Arr<KeyPair<T>>::_length;
-			auto& keyPair = Arr<KeyPair<T>>::_ptr[index];
-
-			// If the hash is different, continue.
-			if (keyPair.key == key)
-				return &keyPair.value;
+			_ctrl[index] = EMPTY;
+			++_growthLeft;
 		}
-
-		return nullptr;
+		else
+			_ctrl[index] = DELETED;
+		--_count;
 	}
-	template<typename T>
-	inline void Map<T>::erase(T& value)
+	template<typename T, typename K, typename H>
+	inline uint32_t Map<T, K, H>::count()
 	{
-		uint64_t index;
-		const bool contains = contains(value, index);
-		assert(contains);
-		assert(_count > 0);
+		return _count;
+	}
+	template<typename T, typename K, typename H>
+	template<typename U>
+	inline void Map<T, K, H>::iter(U func) const
+	{
+		for (uint32_t i = 0; i < _capacity; i++)
+			if (_ctrl[i] >= 0)
+				func(_slots[i].key, _slots[i].value);
+	}
+	template<typename T, typename K, typename H>
+	inline uint32_t Map<T, K, H>::_match(const int8_t* group, const int8_t value)
+	{
+#ifdef MEM_MAP_SSE2
+		const __m128i ctrl = _mm_load_si128(reinterpret_cast<const __m128i*>(group));
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(value))));
+#else
+		uint32_t mask = 0;
+		for (uint32_t i = 0; i < GROUP_SIZE; i++)
+			mask |= static_cast<uint32_t>(group[i] == value) << i;
+		return mask;
+#endif
+	}
+	template<typename T, typename K, typename H>
+	inline uint32_t Map<T, K, H>::_matchEmpty(const int8_t* group)
+	{
+		return _match(group, EMPTY);
+	}
+	template<typename T, typename K, typename H>
+	inline uint32_t Map<T, K, H>::_matchFree(const int8_t* group)
+	{
+#ifdef MEM_MAP_SSE2
+		// Empty and deleted are the only negative control bytes.
+		const __m128i ctrl = _mm_load_si128(reinterpret_cast<const __m128i*>(group));
+		return static_cast<uint32_t>(_mm_movemask_epi8(ctrl));
+#else
+		uint32_t mask = 0;
+		for (uint32_t i = 0; i < GROUP_SIZE; i++)
+			mask |= static_cast<uint32_t>(group[i] < 0) << i;
+		return mask;
+#endif
+	}
+	template<typename T, typename K, typename H>
+	inline uint32_t Map<T, K, H>::_lowestBit(const uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+	template<typename T, typename K, typename H>
+	inline int64_t Map<T, K, H>::_find(const K& key, const uint64_t hash) const
+	{
+		if (_capacity == 0)
+			return -1;
 
-		auto& keyPair = Arr<KeyPair<T>>::_ptr[index];
+		const int8_t h2 = static_cast<int8_t>(hash & 0x7F);
+		const uint32_t groupMask = _capacity / GROUP_SIZE - 1;
+		uint32_t group = static_cast<uint32_t>(hash >> 7) & groupMask;
 
-		// Check how big the key group is.
-		uint64_t i = 1;
-		while (i < Arr<KeyPair<T>>::_length)
+		// Triangular probing visits every group once when the group count is a power of two.
+		for (uint32_t step = 1; step <= groupMask + 1; step++)
 		{
-			const uint64_t otherIndex = (index + i) % Arr<KeyPair<T>>::_length;
-			auto& otherKeyPair = Arr<KeyPair<T>>::_ptr[otherIndex];
-			if (otherKeyPair.key != keyPair.key)
-				break;
-			++i;
+			const int8_t* ctrl = &_ctrl[group * GROUP_SIZE];
+			uint32_t mask = _match(ctrl, h2);
+			while (mask)
+			{
+				const uint32_t index = group * GROUP_SIZE + _lowestBit(mask);
+				if (H::equal(_slots[index].key, key))
+					return index;
+				mask &= mask - 1;
+			}
+			if (_matchEmpty(ctrl))
+				return -1;
+			group = (group + step) & groupMask;
 		}
+		return -1;
+	}
+	template<typename T, typename K, typename H>
+	inline uint32_t Map<T, K, H>::_findFree(const uint64_t hash) const
+	{
+		const uint32_t groupMask = _capacity / GROUP_SIZE - 1;
+		uint32_t group = static_cast<uint32_t>(hash >> 7) & groupMask;
 
-		// Setting the key pair value to the default value.
-		keyPair = {};
-		// Move the key group one place backwards by swapping the first and last index.
-		T t = Arr<KeyPair<T>>::_ptr[index];
-		Arr<KeyPair<T>>::_ptr[index] = Arr<KeyPair<T>>::_ptr[index + i - 1];
-		Arr<KeyPair<T>>::_ptr[index + i - 1] = t;
-		--_count;
+		for (uint32_t step = 1;; step++)
+		{
+			const uint32_t mask = _matchFree(&_ctrl[group * GROUP_SIZE]);
+			if (mask)
+				return group * GROUP_SIZE + _lowestBit(mask);
+			group = (group + step) & groupMask;
+		}
 	}
-	template<typename T>
-	inline uint32_t Map<T>::count()
+	template<typename T, typename K, typename H>
+	inline void Map<T, K, H>::_allocate(const uint32_t capacity)
 	{
-		return _count;
+		_ctrl = static_cast<int8_t*>(manualAlloc(_arena, capacity, GROUP_SIZE));
+		memset(_ctrl, EMPTY, capacity);
+		_slots = allocUninit<KeyPair<T, K>>(_arena, capacity);
+		_capacity = capacity;
+		_growthLeft = capacity * 7 / 8;
+	}
+	template<typename T, typename K, typename H>
+	inline void Map<T, K, H>::_rehash(const uint32_t capacity)
+	{
+		assert(_arena != NONE);
+		const int8_t* ctrl = _ctrl;
+		KeyPair<T, K>* slots = _slots;
+		const uint32_t oldCapacity = _capacity;
+
+		_allocate(capacity);
+		for (uint32_t i = 0; i < oldCapacity; i++)
+		{
+			if (ctrl[i] < 0)
+				continue;
+			const uint64_t hash = H::hash(slots[i].key);
+			const uint32_t index = _findFree(hash);
+			_ctrl[index] = static_cast<int8_t>(hash & 0x7F);
+			new(&_slots[index].key) K(std::move(slots[i].key));
+			new(&_slots[index].value) T(std::move(slots[i].value));
+			slots[i].~KeyPair<T, K>();
+			--_growthLeft;
+		}
+
+		manualRelease(_arena, slots);
+		manualRelease(_arena, const_cast<int8_t*>(ctrl));
 	}
-	template<typename T>
-	inline uint64_t Map<T>::_hash(uint64_t key) const
+	template<typename T, typename K, typename H>
+	inline void Map<T, K, H>::_dropDeleted()
 	{
-		return key % Arr<KeyPair<T>>::_length;
+		// Deleted slots become empty, and full slots are marked deleted until they have been put back in place.
+		for (uint32_t i = 0; i < _capacity; i++)
+			_ctrl[i] = _ctrl[i] == DELETED ? EMPTY : _ctrl[i] >= 0 ? DELETED : _ctrl[i];
+
+		for (uint32_t i = 0; i < _capacity; i++)
+		{
+			if (_ctrl[i] != DELETED)
+				continue;
+			const uint64_t hash = H::hash(_slots[i].key);
+			const int8_t h2 = static_cast<int8_t>(hash & 0x7F);
+			const uint32_t index = _findFree(hash);
+
+			// Lookups check whole groups, so a slot in the first group with room is already where it belongs.
+			if (index / GROUP_SIZE == i / GROUP_SIZE)
+			{
+				_ctrl[i] = h2;
+				continue;
+			}
+			if (_ctrl[index] == EMPTY)
+			{
+				new(&_slots[index].key) K(std::move(_slots[i].key));
+				new(&_slots[index].value) T(std::move(_slots[i].value));
+				_slots[i].~KeyPair<T, K>();
+				_ctrl[index] = h2;
+				_ctrl[i] = EMPTY;
+				continue;
+			}
+			// The target holds a slot that still has to be put back, which gets swapped in here and handled next.
+			std::swap(_slots[i], _slots[index]);
+			_ctrl[index] = h2;
+			--i;
+		}
+		_growthLeft = _capacity * 7 / 8 - _count;
 	}
 }
 
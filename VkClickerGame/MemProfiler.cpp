@@ -0,0 +1,101 @@
+#include "pch.h"
+#include "MemProfiler.h"
+
+#ifdef MEM_PROFILE
+#include <mutex>
+
+namespace mem
+{
+	constexpr uint32_t PROFILE_CAPACITY = 1024;
+
+	struct ProfileEntry final {
+		const char* tag = nullptr;
+		uint8_t arena = 0;
+		uint64_t bytes = 0;
+		uint64_t count = 0;
+	};
+
+	struct Profiler final {
+		std::mutex mutex{};
+		ProfileEntry* entries = nullptr;
+	} profiler{};
+
+	thread_local const char* profileTag = nullptr;
+
+	ProfileScope::ProfileScope(const char* tag) : _previous(profileTag)
+	{
+		profileTag = tag;
+	}
+	ProfileScope::~ProfileScope()
+	{
+		profileTag = _previous;
+	}
+
+	void p_initProfiler()
+	{
+		assert(!profiler.entries);
+		// Not allocated through the arenas, since that would profile the profiler.
+		profiler.entries = static_cast<ProfileEntry*>(calloc(PROFILE_CAPACITY, sizeof(ProfileEntry)));
+	}
+	void p_endProfiler()
+	{
+		printProfile();
+		free(profiler.entries);
+		profiler.entries = nullptr;
+	}
+	void p_profileAlloc(const uint8_t arena, const size_t size)
+	{
+		const char* tag = profileTag ? profileTag : "untagged";
+		// Tags are pointers, so the low bits are dropped before they are used as a hash.
+		const auto key = (reinterpret_cast<uintptr_t>(tag) >> 3) * 31 + arena;
+
+		std::unique_lock<std::mutex> lock(profiler.mutex);
+		for (uint32_t i = 0; i < PROFILE_CAPACITY; i++)
+		{
+			auto& entry = profiler.entries[(key + i) % PROFILE_CAPACITY];
+			if (entry.tag && (entry.tag != tag || entry.arena != arena))
+				continue;
+			entry.tag = tag;
+			entry.arena = arena;
+			entry.bytes += size;
+			++entry.count;
+			return;
+		}
+		assert(false);
+	}
+	void printProfile()
+	{
+		std::unique_lock<std::mutex> lock(profiler.mutex);
+
+		ProfileEntry sorted[PROFILE_CAPACITY];
+		uint32_t length = 0;
+		for (uint32_t i = 0; i < PROFILE_CAPACITY; i++)
+		{
+			if (!profiler.entries[i].tag)
+				continue;
+			// Insert sorted on the amount of bytes, largest first.
+			uint32_t j = length++;
+			while (j > 0 && sorted[j - 1].bytes < profiler.entries[i].bytes)
+			{
+				sorted[j] = sorted[j - 1];
+				--j;
+			}
+			sorted[j] = profiler.entries[i];
+		}
+
+		std::cout << "Memory profile:" << std::endl;
+		for (uint32_t i = 0; i < length; i++)
+		{
+			const auto& entry = sorted[i];
+			std::cout << entry.bytes << " bytes in " << entry.count << " allocations in ";
+			if (entry.arena == TEMP)
+				std::cout << "TEMP";
+			else if (entry.arena == FRAM)
+				std::cout << "FRAM";
+			else
+				std::cout << "PERS " << static_cast<uint32_t>(RPERN(entry.arena));
+			std::cout << ": " << entry.tag << std::endl;
+		}
+	}
+}
+#endif
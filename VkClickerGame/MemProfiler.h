@@ -0,0 +1,40 @@
+#pragma once
+
+// Define MEM_PROFILE in a debug build to attribute every mem allocation to the innermost profile scope on its thread.
+// Allocations are aggregated per tag and arena, and printed on mem::end or on demand through mem::printProfile.
+// Release builds compile all of this out.
+#if defined(MEM_PROFILE) && !defined(_DEBUG)
+#undef MEM_PROFILE
+#endif
+
+#define MEM_PROFILE_STR_(x) #x
+#define MEM_PROFILE_STR(x) MEM_PROFILE_STR_(x)
+#define MEM_PROFILE_CONCAT_(a, b) a##b
+#define MEM_PROFILE_CONCAT(a, b) MEM_PROFILE_CONCAT_(a, b)
+
+#ifdef MEM_PROFILE
+// Tags have to be string literals or otherwise outlive the profiler, since only the pointer is stored.
+#define MEM_PROFILE_SCOPE(tag) const mem::ProfileScope MEM_PROFILE_CONCAT(_memProfileScope, __LINE__)(tag)
+#define MEM_PROFILE_HERE() MEM_PROFILE_SCOPE(__FILE__ ":" MEM_PROFILE_STR(__LINE__))
+#else
+#define MEM_PROFILE_SCOPE(tag)
+#define MEM_PROFILE_HERE()
+#endif
+
+namespace mem
+{
+#ifdef MEM_PROFILE
+	struct ProfileScope final {
+		ProfileScope(const char* tag);
+		~ProfileScope();
+	private:
+		const char* _previous;
+	};
+
+	void p_initProfiler();
+	void p_endProfiler();
+	// Takes the arena as a plain uint8_t, since this header is included before ARENA is defined.
+	void p_profileAlloc(uint8_t arena, size_t size);
+	void printProfile();
+#endif
+}
@@ -0,0 +1,1019 @@
+#include "pch.h"
+#include "MemSelfTest.h"
+
+#ifdef MEM_SELFTEST
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <typeinfo>
+#include <cmath>
+#include <random>
+#include "Arena.h"
+#include "Tlsf.h"
+#include "Arr.h"
+#include "Vec.h"
+#include "ThreadPool.h"
+#include "SoA.h"
+#include "Map.h"
+
+#define MEM_CHECK(x) check((x), #x, __LINE__)
+
+namespace mem
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	// Owned by mem.cpp, read here to see whether containers hand memory back.
+	extern jv::Tlsf* tlsfArenas;
+
+	uint32_t selfTestFailures = 0;
+	// Benchmark results end up here, so the compiler can not drop the work.
+	volatile uint64_t selfTestSink = 0;
+
+	void check(const bool ok, const char* expression, const int line)
+	{
+		if (ok)
+			return;
+		++selfTestFailures;
+		std::cout << "FAILED (MemSelfTest.cpp:" << line << "): " << expression << std::endl;
+	}
+	double nsPer(const Clock::time_point start, const uint64_t count)
+	{
+		return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(count);
+	}
+	void* selfTestAlloc(const uint64_t size)
+	{
+		return malloc(size);
+	}
+	void selfTestFree(void* ptr)
+	{
+		free(ptr);
+	}
+	jv::ArenaCreateInfo selfTestArenaInfo(const uint64_t size)
+	{
+		jv::ArenaCreateInfo info{};
+		info.alloc = selfTestAlloc;
+		info.free = selfTestFree;
+		info.memorySize = size;
+		return info;
+	}
+
+	void testArenaChain(const bool benchmarks)
+	{
+		auto arena = jv::Arena::Create(selfTestArenaInfo(4096));
+		const uint64_t root = arena.CreateScope();
+		char* ptrs[2000];
+		for (uint32_t i = 0; i < 2000; i++)
+		{
+			ptrs[i] = static_cast<char*>(arena.Alloc(100));
+			memset(ptrs[i], i & 0xFF, 100);
+		}
+		bool intact = true;
+		for (uint32_t i = 0; i < 2000; i++)
+			for (uint32_t j = 0; j < 100; j++)
+				intact &= static_cast<uint8_t>(ptrs[i][j]) == (i & 0xFF);
+		MEM_CHECK(intact);
+
+		for (uint32_t i = 1999; i >= 1000; i--)
+			arena.Free(ptrs[i]);
+		uint32_t depth, depthAfter;
+		uint64_t front, frontAfter;
+		arena.GetFront(depth, front);
+		MEM_CHECK(depth > 0);
+		const uint64_t scope = arena.CreateScope();
+		for (uint32_t i = 0; i < 500; i++)
+			(void)arena.Alloc(100);
+		arena.DestroyScope(scope);
+		arena.GetFront(depthAfter, frontAfter);
+		MEM_CHECK(depthAfter == depth && frontAfter == front);
+		arena.DestroyScope(root);
+		arena.GetFront(depth, front);
+		MEM_CHECK(depth == 0 && front == 0);
+
+		// The cost per allocation should stay flat as the chain grows.
+		if (benchmarks)
+			for (const uint32_t blocks : { 1, 8, 64, 256 })
+			{
+				arena.Clear();
+				for (uint32_t i = 1; i < blocks; i++)
+					(void)arena.Alloc(4000);
+				const uint64_t start = arena.CreateScope();
+				const auto time = Clock::now();
+				for (uint32_t r = 0; r < 2000; r++)
+				{
+					for (uint32_t i = 0; i < 32; i++)
+						(void)arena.Alloc(16);
+					arena.DestroyScope(start);
+				}
+				std::cout << "arena chain of " << blocks << " blocks: " << nsPer(time, 2000 * 32) << " ns per alloc" << std::endl;
+			}
+		jv::Arena::Destroy(arena);
+	}
+
+	void testArenaSizes(const bool benchmarks)
+	{
+		// Only reserved, and the pages past 4 GiB are committed without being touched except for one byte.
+		constexpr uint64_t GIB = 1024ull * 1024 * 1024;
+		auto info = selfTestArenaInfo(8 * GIB);
+		info.virtualMemory = true;
+		auto arena = jv::Arena::Create(info);
+		MEM_CHECK(arena.memory != nullptr);
+		if (arena.memory)
+		{
+			auto large = static_cast<char*>(arena.Alloc(5 * GIB));
+			large[5 * GIB - 1] = 1;
+			const uint64_t scope = arena.CreateScope();
+			(void)arena.Alloc(64);
+			MEM_CHECK(arena.GetUsedMemory() > 5 * GIB);
+			arena.DestroyScope(scope);
+			uint32_t depth;
+			uint64_t front;
+			arena.GetFront(depth, front);
+			MEM_CHECK(depth == 0 && front > 5 * GIB && front < 5 * GIB + 64);
+			arena.Free(large);
+			MEM_CHECK(arena.GetUsedMemory() == 0);
+		}
+		jv::Arena::Destroy(arena);
+
+		// Without a cache the chained blocks stay around, and destroying a scope has to decommit all of them.
+		{
+			auto chainInfo = selfTestArenaInfo(4 * 1024 * 1024);
+			chainInfo.virtualMemory = true;
+			chainInfo.decommitThreshold = 0;
+			auto chained = jv::Arena::Create(chainInfo);
+			const uint64_t scope = chained.CreateScope();
+			for (uint32_t i = 0; i < 4; i++)
+				memset(chained.Alloc(3 * 1024 * 1024), 1, 3 * 1024 * 1024);
+			uint32_t blocks = 0;
+			for (const jv::Arena* block = chained.next; block; block = block->next)
+				++blocks;
+			chained.DestroyScope(scope);
+			bool decommitted = chained.committed < 1024 * 1024;
+			for (const jv::Arena* block = chained.next; block; block = block->next)
+				decommitted &= block->committed < 1024 * 1024;
+			MEM_CHECK(blocks == 3 && decommitted);
+			jv::Arena::Destroy(chained);
+		}
+
+		// Counts past 32 bits have to reach the arena as they are.
+		{
+			Info info{};
+			info.tempSize = 8 * GIB;
+			info.virtualMemory = true;
+			init(info);
+			{
+				auto _ = scope(TEMP);
+				auto large = allocUninit<char>(TEMP, 5 * GIB);
+				auto after = allocUninit<char>(TEMP);
+				MEM_CHECK(after >= large + 5 * GIB);
+			}
+			end();
+		}
+
+		// Small allocations through mem, which went through the 64 bit size changes.
+		if (benchmarks)
+		{
+			init();
+			for (uint32_t r = 0; r < 3; r++)
+			{
+				auto _ = scope(TEMP);
+				const auto time = Clock::now();
+				for (uint32_t i = 0; i < 1000000; i++)
+					*alloc<uint32_t>(TEMP) = i;
+				std::cout << "small allocations: " << nsPer(time, 1000000) << " ns per alloc" << std::endl;
+			}
+			end();
+		}
+	}
+
+	void testConcurrentArena(const bool benchmarks)
+	{
+		ArenaType types[] = { ArenaType::linear, ArenaType::concurrent };
+		Info info{};
+		info.persistentLength = 2;
+		info.persistentTypes = types;
+		// Small blocks, so the producers keep chaining new ones.
+		info.persistentDefaultSize = 1 << 16;
+		init(info);
+
+		constexpr uint32_t ALLOCATIONS = 100000;
+		for (const uint32_t producers : { 1, 2, 4, 8 })
+		{
+			auto scope = manualScope(PERN(1));
+			auto _ = mem::scope(TEMP);
+			auto ptrs = Arr<uint64_t*>(TEMP, producers * ALLOCATIONS, uninit);
+			auto threads = Arr<std::thread>(TEMP, producers);
+
+			const auto time = Clock::now();
+			threads.iter([&ptrs](std::thread& thread, const uint32_t t) {
+				thread = std::thread([&ptrs, t] {
+					for (uint32_t i = 0; i < ALLOCATIONS; i++)
+					{
+						auto ptr = alloc<uint64_t>(PERN(1), 2);
+						ptr[0] = t;
+						ptr[1] = i;
+						ptrs[t * ALLOCATIONS + i] = ptr;
+					}
+					});
+				});
+			threads.iter([](std::thread& thread, uint32_t) {
+				thread.join();
+				});
+			const double ns = nsPer(time, producers * ALLOCATIONS);
+
+			bool intact = true;
+			for (uint32_t i = 0; i < producers * ALLOCATIONS; i++)
+				intact &= ptrs[i][0] == i / ALLOCATIONS && ptrs[i][1] == i % ALLOCATIONS;
+			MEM_CHECK(intact);
+			if (benchmarks)
+				std::cout << "concurrent arena with " << producers << " producers: " << ns << " ns per alloc" << std::endl;
+			scope.clear();
+		}
+		end();
+	}
+
+	void testTlsf(const bool benchmarks)
+	{
+		struct Live final
+		{
+			uint8_t* ptr;
+			uint32_t size;
+			uint8_t value;
+		};
+
+		auto tlsf = jv::Tlsf::Create(selfTestArenaInfo(1 << 20));
+		std::mt19937 rng(1);
+		auto live = static_cast<Live*>(malloc(sizeof(Live) * 200000));
+		uint32_t liveCount = 0;
+		bool aligned = true, intact = true;
+		for (uint32_t i = 0; i < 200000; i++)
+		{
+			if (liveCount == 0 || rng() % 3 != 0)
+			{
+				// Mostly small, with the occasional allocation that needs a new pool.
+				const uint32_t size = rng() % (rng() % 10 == 0 ? 100000 : 300) + 1;
+				const uint32_t alignment = 1u << (rng() % 8);
+				auto ptr = static_cast<uint8_t*>(tlsf.Alloc(size, alignment));
+				aligned &= reinterpret_cast<uintptr_t>(ptr) % alignment == 0;
+				const auto value = static_cast<uint8_t>(rng());
+				memset(ptr, value, size);
+				live[liveCount++] = { ptr, size, value };
+				continue;
+			}
+
+			const uint32_t index = rng() % liveCount;
+			const Live entry = live[index];
+			for (uint32_t j = 0; j < entry.size; j++)
+				intact &= entry.ptr[j] == entry.value;
+			tlsf.Free(entry.ptr);
+			live[index] = live[--liveCount];
+		}
+		MEM_CHECK(aligned);
+		MEM_CHECK(intact);
+		free(live);
+		jv::Tlsf::Destroy(tlsf);
+
+		if (!benchmarks)
+			return;
+
+		// Mixed lifetimes: every operation frees a random slot of the ring and fills it again.
+		constexpr uint32_t RING = 4096;
+		constexpr uint32_t OPERATIONS = 2000000;
+		void* ring[RING];
+		auto trace = [&ring](const char* name, auto allocFunc, auto freeFunc) {
+			std::mt19937 rng(2);
+			memset(ring, 0, sizeof ring);
+			const auto time = Clock::now();
+			for (uint32_t i = 0; i < OPERATIONS; i++)
+			{
+				void*& slot = ring[rng() % RING];
+				if (slot)
+					freeFunc(slot);
+				slot = allocFunc(16 + rng() % 512);
+			}
+			for (void* ptr : ring)
+				if (ptr)
+					freeFunc(ptr);
+			std::cout << name << " mixed lifetimes: " << nsPer(time, OPERATIONS) << " ns per operation" << std::endl;
+		};
+
+		tlsf = jv::Tlsf::Create(selfTestArenaInfo(64 << 20));
+		trace("tlsf", [&tlsf](const uint32_t size) { return tlsf.Alloc(size); }, [&tlsf](void* ptr) { tlsf.Free(ptr); });
+		jv::Tlsf::Destroy(tlsf);
+		trace("malloc", [](const uint32_t size) { return malloc(size); }, [](void* ptr) { free(ptr); });
+
+		// A linear arena can not free out of order, so it is cleared every time the ring has been replaced on average.
+		auto arena = jv::Arena::Create(selfTestArenaInfo(64 << 20));
+		uint32_t arenaOperations = 0;
+		trace("arena", [&arena, &arenaOperations](const uint32_t size) {
+			if (++arenaOperations % RING == 0)
+				arena.Clear();
+			return arena.Alloc(size);
+			}, [](void*) {});
+		jv::Arena::Destroy(arena);
+	}
+
+	void testVec(const bool benchmarks)
+	{
+		struct Counted final
+		{
+			uint32_t value = 0;
+			Counted() {}
+			Counted(Counted&& other) noexcept : value(other.value) {}
+			Counted& operator=(const Counted& other) = default;
+		};
+
+		Info info{};
+		info.tempSize = 1 << 28;
+		init(info);
+		{
+			auto _ = scope(TEMP);
+			auto ints = Vec<uint32_t>(TEMP, 0);
+			auto counted = Vec<Counted>(TEMP, 1);
+			// Allocating in between keeps the vectors from being the front allocation, so they have to relocate.
+			for (uint32_t i = 0; i < 100000; i++)
+			{
+				ints.add() = i;
+				counted.add().value = i;
+			}
+			bool intact = true;
+			for (uint32_t i = 0; i < 100000; i++)
+				intact &= ints[i] == i && counted[i].value == i;
+			MEM_CHECK(intact);
+
+			// Opening and closing a scope in between does not count as growing from a deeper scope.
+			{
+				auto inner = scope(TEMP);
+				MEM_CHECK(scopeDepth(TEMP) == 2);
+			}
+			MEM_CHECK(scopeDepth(TEMP) == 1);
+			for (uint32_t i = 0; i < 100000; i++)
+				ints.add() = i;
+			MEM_CHECK(ints.count() == 200000 && ints[199999] == 99999);
+
+			// A vector made from an array fills it up, but has no arena to grow into.
+			auto fixed = Arr<uint32_t>(TEMP, 4);
+			auto view = Vec<uint32_t>(fixed);
+			view.clear();
+			for (uint32_t i = 0; i < 4; i++)
+				view.add() = i;
+			bool threw = false;
+			try
+			{
+				view.add();
+			}
+			catch (const std::exception&)
+			{
+				threw = true;
+			}
+			MEM_CHECK(threw && view.count() == 4 && fixed[3] == 3);
+		}
+
+		end();
+
+		// On a TLSF arena every growth relocates, and the old buffer has to be freed along with the moved-from elements.
+		ArenaType types[] = { ArenaType::tlsf };
+		uint64_t sizes[] = { 1 << 20 };
+		info.persistentLength = 1;
+		info.persistentTypes = types;
+		info.persistentInitSizes = sizes;
+		init(info);
+		{
+			static uint32_t live = 0;
+			struct Tracked final
+			{
+				Tracked() { ++live; }
+				Tracked(Tracked&&) noexcept { ++live; }
+				~Tracked() { --live; }
+			};
+
+			// The first round decides how many pools the growth pattern needs, after which nothing should be added.
+			uint64_t pools = 0;
+			for (uint32_t r = 0; r < 100; r++)
+			{
+				auto ints = Vec<uint32_t>(PERS, 1);
+				for (uint32_t i = 0; i < 100000; i++)
+					ints.add() = i;
+				manualFree(PERS, ints.ptr());
+				pools = r == 0 ? tlsfArenas[PERS].GetTotalUsedMemory() : pools;
+			}
+			MEM_CHECK(tlsfArenas[PERS].GetTotalUsedMemory() == pools);
+
+			auto tracked = Vec<Tracked>(PERS, 0);
+			for (uint32_t i = 0; i < 1000; i++)
+				tracked.add();
+			MEM_CHECK(live == 1000);
+		}
+
+		// More callbacks than the pool was made for, which it has to make room for on this thread.
+		static std::atomic<uint32_t> ran{ 0 }, called{ 0 };
+		ThreadPoolInfo poolInfo{};
+		poolInfo.taskCapacity = 4;
+		p_initThreadPool(poolInfo);
+		for (uint32_t r = 0; r < 3; r++)
+		{
+			for (uint32_t i = 0; i < 3; i++)
+			{
+				ThreadPoolTask task{};
+				task.func = [](void*, uint32_t, uint32_t) { ++ran; };
+				task.callback = [](void*, uint32_t) { ++called; };
+				addThreadPoolTask(task);
+			}
+			while (ran.load() < (r + 1) * 3)
+				std::this_thread::yield();
+		}
+
+		// A task that is still being worked on keeps the pool from being idle, which frame asserts on.
+		static std::atomic<bool> hold{ true };
+		ThreadPoolTask blocking{};
+		blocking.func = [](void*, uint32_t, uint32_t) {
+			while (hold.load())
+				std::this_thread::yield();
+			};
+		addThreadPoolTask(blocking);
+		MEM_CHECK(!threadPoolIdle());
+		hold = false;
+		const auto deadline = Clock::now() + std::chrono::seconds(10);
+		while (!threadPoolIdle() && Clock::now() < deadline)
+			std::this_thread::yield();
+		MEM_CHECK(threadPoolIdle());
+		frame();
+		threadPoolUpdate();
+		MEM_CHECK(called.load() == 9);
+		destroyThreadPool();
+
+		if (benchmarks)
+			for (uint32_t r = 0; r < 3; r++)
+			{
+				{
+					auto _ = scope(TEMP);
+					const auto time = Clock::now();
+					auto vec = Vec<uint32_t>(TEMP, 0);
+					for (uint32_t i = 0; i < 10000000; i++)
+						vec.add() = i;
+					std::cout << "vec append: " << nsPer(time, 10000000) << " ns per add" << std::endl;
+				}
+				const auto time = Clock::now();
+				std::vector<uint32_t> vector;
+				for (uint32_t i = 0; i < 10000000; i++)
+					vector.push_back(i);
+				std::cout << "std::vector append: " << nsPer(time, 10000000) << " ns per add" << std::endl;
+			}
+		end();
+	}
+
+	// Fills values with one of the input patterns the sorts are compared on.
+	void fillPattern(const Arr<int32_t>& values, const uint32_t pattern, std::mt19937& rng)
+	{
+		const uint32_t length = values.length();
+		for (uint32_t i = 0; i < length; i++)
+			switch (pattern)
+			{
+			case 0:
+				values[i] = static_cast<int32_t>(rng());
+				break;
+			case 1:
+				values[i] = static_cast<int32_t>(i);
+				break;
+			case 2:
+				values[i] = static_cast<int32_t>(length - i);
+				break;
+			default:
+				values[i] = static_cast<int32_t>(rng() % 8);
+				break;
+			}
+	}
+	const char* PATTERN_NAMES[] = { "random", "sorted", "reversed", "few unique" };
+
+	void testSort(const bool benchmarks)
+	{
+		Info info{};
+		info.tempSize = 1 << 28;
+		init(info);
+		std::mt19937 rng(3);
+		auto less = [](const int32_t a, const int32_t b) { return a < b; };
+
+		for (const uint32_t length : { 0, 1, 2, 23, 24, 25, 100, 1000, 100000 })
+			for (uint32_t pattern = 0; pattern < 4; pattern++)
+			{
+				auto _ = scope(TEMP);
+				auto values = Arr<int32_t>(TEMP, length, uninit);
+				fillPattern(values, pattern, rng);
+				auto expected = values.copy(TEMP);
+				std::sort(expected.ptr(), expected.ptr() + length);
+
+				auto sorted = values.copy(TEMP);
+				sorted.sort(less);
+				MEM_CHECK(memcmp(sorted.ptr(), expected.ptr(), sizeof(int32_t) * length) == 0);
+
+				// The original stays in place, and the indices have to put it in order.
+				auto indices = values.makeExtSort(TEMP);
+				values.extSort(indices, less);
+				values.applyExtSort(indices);
+				MEM_CHECK(memcmp(values.ptr(), expected.ptr(), sizeof(int32_t) * length) == 0);
+			}
+
+		if (benchmarks)
+			for (uint32_t pattern = 0; pattern < 4; pattern++)
+			{
+				constexpr uint32_t LENGTH = 1000000;
+				auto _ = scope(TEMP);
+				auto values = Arr<int32_t>(TEMP, LENGTH, uninit);
+				fillPattern(values, pattern, rng);
+				auto copy = values.copy(TEMP);
+
+				auto time = Clock::now();
+				copy.sort(less);
+				const double sortNs = nsPer(time, LENGTH);
+				copy.put(0, values);
+				time = Clock::now();
+				std::sort(copy.ptr(), copy.ptr() + LENGTH, less);
+				std::cout << "sort " << PATTERN_NAMES[pattern] << ": " << sortNs << " ns per element, std::sort "
+					<< nsPer(time, LENGTH) << std::endl;
+			}
+		end();
+	}
+
+	enum class SelfTestKey : int8_t {};
+
+	// Radix sorts pairs by key and checks the result against std::stable_sort, which it has to match exactly.
+	template <typename K, typename U>
+	void checkRadixKey(U makeKey, std::mt19937& rng)
+	{
+		struct Entry final
+		{
+			K key;
+			uint32_t index;
+		};
+
+		constexpr uint32_t LENGTH = 20000;
+		auto _ = scope(TEMP);
+		auto entries = Arr<Entry>(TEMP, LENGTH, uninit);
+		for (uint32_t i = 0; i < LENGTH; i++)
+			entries[i] = { makeKey(rng), i };
+		auto expected = entries.copy(TEMP);
+		std::stable_sort(expected.ptr(), expected.ptr() + LENGTH, [](const Entry& a, const Entry& b) { return a.key < b.key; });
+
+		entries.radixSort([](const Entry& entry) { return entry.key; });
+		bool same = true;
+		for (uint32_t i = 0; i < LENGTH; i++)
+			same &= entries[i].index == expected[i].index;
+		check(same, typeid(K).name(), __LINE__);
+	}
+
+	void testRadixSort(const bool benchmarks)
+	{
+		Info info{};
+		info.tempSize = 1 << 28;
+		init(info);
+		std::mt19937 rng(4);
+
+		checkRadixKey<int8_t>([](std::mt19937& r) { return static_cast<int8_t>(r()); }, rng);
+		checkRadixKey<uint16_t>([](std::mt19937& r) { return static_cast<uint16_t>(r()); }, rng);
+		checkRadixKey<int16_t>([](std::mt19937& r) { return static_cast<int16_t>(r()); }, rng);
+		checkRadixKey<int32_t>([](std::mt19937& r) { return static_cast<int32_t>(r()); }, rng);
+		checkRadixKey<uint32_t>([](std::mt19937& r) { return static_cast<uint32_t>(r() % 1000); }, rng);
+		checkRadixKey<int64_t>([](std::mt19937& r) { return static_cast<int64_t>(static_cast<int32_t>(r())) * 1000003; }, rng);
+		checkRadixKey<char>([](std::mt19937& r) { return static_cast<char>(r()); }, rng);
+		checkRadixKey<bool>([](std::mt19937& r) { return (r() & 1) != 0; }, rng);
+		checkRadixKey<long>([](std::mt19937& r) { return static_cast<long>(static_cast<int32_t>(r())); }, rng);
+		checkRadixKey<SelfTestKey>([](std::mt19937& r) { return static_cast<SelfTestKey>(r()); }, rng);
+		checkRadixKey<float>([](std::mt19937& r) { return static_cast<float>(static_cast<int32_t>(r())) / 7.0f; }, rng);
+		checkRadixKey<double>([](std::mt19937& r) { return static_cast<double>(static_cast<int32_t>(r())) / 7.0; }, rng);
+
+		// The extSort variant only moves indices.
+		{
+			auto _ = scope(TEMP);
+			auto values = Arr<float>(TEMP, 1000, uninit);
+			for (uint32_t i = 0; i < 1000; i++)
+				values[i] = static_cast<float>(static_cast<int32_t>(rng() % 2000) - 1000);
+			auto indices = values.makeExtSort(TEMP);
+			values.radixExtSort(indices, [](const float value) { return value; });
+			values.applyExtSort(indices);
+			bool sorted = true;
+			for (uint32_t i = 1; i < 1000; i++)
+				sorted &= values[i - 1] <= values[i];
+			MEM_CHECK(sorted);
+		}
+
+		if (benchmarks)
+			for (const uint32_t length : { 10000, 100000, 1000000 })
+			{
+				auto _ = scope(TEMP);
+				auto values = Arr<uint32_t>(TEMP, length, uninit);
+				for (uint32_t i = 0; i < length; i++)
+					values[i] = rng();
+				auto copy = values.copy(TEMP);
+
+				auto time = Clock::now();
+				copy.radixSort([](const uint32_t value) { return value; });
+				const double radixNs = nsPer(time, length);
+				copy.put(0, values);
+				time = Clock::now();
+				copy.sort([](const uint32_t a, const uint32_t b) { return a < b; });
+				std::cout << "radix sort of " << length << " keys: " << radixNs << " ns per key, sort " << nsPer(time, length) << std::endl;
+			}
+		end();
+	}
+
+	std::atomic<bool> releaseWorkers{ false };
+	std::atomic<uint32_t> blockedWorkers{ 0 };
+
+	bool parallelSortMatches(const uint32_t length, const uint32_t pattern, std::mt19937& rng)
+	{
+		auto _ = scope(TEMP);
+		auto values = Arr<int32_t>(TEMP, length, uninit);
+		fillPattern(values, pattern, rng);
+		auto expected = values.copy(TEMP);
+		std::sort(expected.ptr(), expected.ptr() + length);
+		values.parallelSort([](const int32_t a, const int32_t b) { return a < b; }, 1000);
+		return memcmp(values.ptr(), expected.ptr(), sizeof(int32_t) * length) == 0;
+	}
+
+	void testParallelSort(const bool benchmarks)
+	{
+		Info info{};
+		info.tempSize = 1 << 28;
+		init(info);
+		std::mt19937 rng(5);
+		ThreadPoolInfo poolInfo{};
+		poolInfo.taskCapacity = 3;
+		p_initThreadPool(poolInfo);
+
+		for (const uint32_t length : { 0, 1, 999, 1000, 12345, 200001 })
+			for (uint32_t pattern = 0; pattern < 4; pattern++)
+				MEM_CHECK(parallelSortMatches(length, pattern, rng));
+
+		// With every worker stuck, the calling thread has to finish the sort on its own instead of waiting on its tasks.
+		ThreadPoolTask block{};
+		block.func = [](void*, uint32_t, uint32_t) {
+			++blockedWorkers;
+			while (!releaseWorkers.load())
+				std::this_thread::yield();
+		};
+		const uint32_t workers = getThreadCapacity();
+		for (uint32_t i = 0; i < workers; i++)
+			addThreadPoolTask(block);
+		while (blockedWorkers.load() < workers)
+			std::this_thread::yield();
+		MEM_CHECK(parallelSortMatches(500000, 0, rng));
+		// A full queue falls back to the serial sort.
+		uint32_t queued = 0;
+		while (tryAddThreadPoolTask(block))
+			++queued;
+		MEM_CHECK(parallelSortMatches(500000, 0, rng));
+		releaseWorkers = true;
+		while (blockedWorkers.load() < workers + queued)
+			std::this_thread::yield();
+
+		if (benchmarks)
+		{
+			constexpr uint32_t LENGTH = 4000000;
+			auto _ = scope(TEMP);
+			auto values = Arr<int32_t>(TEMP, LENGTH, uninit);
+			fillPattern(values, 0, rng);
+			auto copy = values.copy(TEMP);
+			auto less = [](const int32_t a, const int32_t b) { return a < b; };
+
+			auto time = Clock::now();
+			copy.parallelSort(less);
+			const double parallelNs = nsPer(time, LENGTH);
+			copy.put(0, values);
+			time = Clock::now();
+			copy.sort(less);
+			std::cout << "parallel sort on " << workers << " workers: " << parallelNs << " ns per element, sort "
+				<< nsPer(time, LENGTH) << std::endl;
+		}
+		destroyThreadPool();
+		end();
+	}
+
+	// Compares the vectorized Arr operations with plain loops, on every length around the vector widths.
+	template <typename T>
+	void checkSimd(std::mt19937& rng)
+	{
+		bool same = true;
+		for (uint32_t length = 0; length < 300; length++)
+		{
+			auto _ = scope(TEMP);
+			// Offset by one element, so the kernels also start at unaligned addresses.
+			auto values = Arr<T>(TEMP, length + 1, uninit).last(length);
+			for (uint32_t i = 0; i < length; i++)
+				values[i] = static_cast<T>(rng() % 50);
+
+			const T needle = static_cast<T>(rng() % 50);
+			int32_t index = -1;
+			uint32_t count = 0;
+			T min = length > 0 ? values[0] : T(), max = min, sum = T();
+			for (uint32_t i = 0; i < length; i++)
+			{
+				if (values[i] == needle)
+				{
+					index = index == -1 ? static_cast<int32_t>(i) : index;
+					++count;
+				}
+				min = values[i] < min ? values[i] : min;
+				max = values[i] > max ? values[i] : max;
+				sum += values[i];
+			}
+
+			same &= values.contains(needle) == index;
+			same &= values.countOf(needle) == count;
+			if (length > 0)
+				same &= values.min() == min && values.max() == max;
+			// Floats are summed in a different order.
+			same &= std::abs(static_cast<double>(values.sum()) - static_cast<double>(sum)) <= 1e-3 * static_cast<double>(sum);
+			values.fill(needle);
+			same &= values.countOf(needle) == length;
+		}
+		check(same, typeid(T).name(), __LINE__);
+	}
+
+	void testSimd(const bool benchmarks)
+	{
+		Info info{};
+		info.tempSize = 1 << 28;
+		init(info);
+		std::mt19937 rng(6);
+		std::cout << "simd: " << (simdHasAvx2() ? "avx2" : "sse2 or scalar") << std::endl;
+
+		checkSimd<uint8_t>(rng);
+		checkSimd<uint16_t>(rng);
+		checkSimd<int32_t>(rng);
+		checkSimd<uint32_t>(rng);
+		checkSimd<uint64_t>(rng);
+		checkSimd<float>(rng);
+		checkSimd<double>(rng);
+
+		if (benchmarks)
+			for (uint32_t size = 1024; size <= 64 * 1024 * 1024; size *= 16)
+			{
+				auto _ = scope(TEMP);
+				const uint32_t length = size / sizeof(uint32_t);
+				// Zeroed, so the first fill does not pay for the page faults.
+				auto values = Arr<uint32_t>(TEMP, length);
+				// Enough repeats for the small sizes to be measurable.
+				const uint32_t repeats = 64 * 1024 * 1024 / size;
+				auto bandwidth = [size, repeats](const Clock::time_point start) {
+					return static_cast<double>(size) * repeats / nsPer(start, 1);
+				};
+
+				auto time = Clock::now();
+				for (uint32_t r = 0; r < repeats; r++)
+					values.fill(r);
+				const double fill = bandwidth(time);
+				uint64_t sink = 0;
+				time = Clock::now();
+				for (uint32_t r = 0; r < repeats; r++)
+					sink += static_cast<uint32_t>(values.contains(repeats));
+				const double contains = bandwidth(time);
+				time = Clock::now();
+				for (uint32_t r = 0; r < repeats; r++)
+					sink += values.countOf(r);
+				const double count = bandwidth(time);
+				time = Clock::now();
+				for (uint32_t r = 0; r < repeats; r++)
+					sink += values.min();
+				const double min = bandwidth(time);
+				time = Clock::now();
+				for (uint32_t r = 0; r < repeats; r++)
+					sink += values.sum();
+				const double sum = bandwidth(time);
+				std::cout << size / 1024 << " KiB of uint32_t in GB/s: fill " << fill << ", contains " << contains
+					<< ", count " << count << ", min " << min << ", sum " << sum << std::endl;
+				selfTestSink = sink;
+			}
+		end();
+	}
+
+	struct SelfTestVector final
+	{
+		float x, y;
+	};
+
+	void testSoA(const bool benchmarks)
+	{
+		ArenaType types[] = { ArenaType::tlsf };
+		uint64_t sizes[] = { 1 << 20 };
+		Info info{};
+		info.tempSize = 1 << 30;
+		info.persistentLength = 1;
+		info.persistentTypes = types;
+		info.persistentInitSizes = sizes;
+		init(info);
+		{
+			auto _ = scope(TEMP);
+			auto soa = SoA<SelfTestVector, double, uint8_t>(TEMP, 0);
+			bool added = true;
+			for (uint32_t i = 0; i < 1000; i++)
+				added &= soa.add({ static_cast<float>(i), 1.0f }, i * 0.5, static_cast<uint8_t>(i)) == i;
+			MEM_CHECK(added && soa.count() == 1000);
+			MEM_CHECK(reinterpret_cast<uintptr_t>(soa.column<0>().ptr()) % 64 == 0);
+			MEM_CHECK(reinterpret_cast<uintptr_t>(soa.column<1>().ptr()) % 64 == 0);
+			MEM_CHECK(reinterpret_cast<uintptr_t>(soa.column<2>().ptr()) % 64 == 0);
+			bool intact = true;
+			for (uint32_t i = 0; i < 1000; i++)
+				intact &= soa.get<0>(i).x == static_cast<float>(i) && soa.get<1>(i) == i * 0.5 && soa.get<2>(i) == static_cast<uint8_t>(i);
+			MEM_CHECK(intact);
+
+			// The last element is swapped into the gap.
+			soa.remove(10);
+			MEM_CHECK(soa.count() == 999 && soa.get<1>(10) == 999 * 0.5 && soa.get<2>(10) == static_cast<uint8_t>(999));
+			const uint32_t zeroed = soa.add();
+			MEM_CHECK(soa.get<0>(zeroed).x == 0 && soa.get<1>(zeroed) == 0);
+			soa.resize(5000);
+			MEM_CHECK(soa.count() == 5000 && soa.get<1>(4999) == 0 && soa.get<1>(3) == 1.5);
+			soa.resize(4);
+			MEM_CHECK(soa.column<1>().sum() == 0 + 0.5 + 1 + 1.5);
+		}
+
+		// Every growth on a TLSF arena has to free the allocation it moved out of.
+		{
+			// The first round decides how many pools the growth pattern needs, after which nothing should be added.
+			uint64_t pools = 0;
+			for (uint32_t r = 0; r < 100; r++)
+			{
+				auto soa = SoA<SelfTestVector, double, uint8_t>(PERS, 1);
+				for (uint32_t i = 0; i < 100000; i++)
+					soa.add();
+				manualFree(PERS, soa.column<0>().ptr());
+				pools = r == 0 ? tlsfArenas[PERS].GetTotalUsedMemory() : pools;
+			}
+			MEM_CHECK(tlsfArenas[PERS].GetTotalUsedMemory() == pools);
+		}
+
+		if (benchmarks)
+		{
+			struct Particle final
+			{
+				SelfTestVector position;
+				SelfTestVector velocity;
+				float life;
+				uint32_t value;
+				uint32_t color;
+				float scale;
+				char label[32];
+			};
+
+			for (const uint32_t length : { 1024, 65536, 1 << 20 })
+			{
+				auto _ = scope(TEMP);
+				auto aos = Arr<Particle>(TEMP, length);
+				auto soa = SoA<SelfTestVector, SelfTestVector, float, uint32_t, uint32_t, float, char[32]>(TEMP, length);
+				soa.resize(length);
+				for (uint32_t i = 0; i < length; i++)
+				{
+					aos[i].velocity = soa.get<1>(i) = { 1.0f, 2.0f };
+					aos[i].life = soa.get<2>(i) = static_cast<float>(1 + i % 10);
+					aos[i].value = soa.get<3>(i) = i;
+				}
+				const uint32_t repeats = (1 << 26) / length;
+
+				// Moves every particle, which only touches position, velocity and life.
+				auto time = Clock::now();
+				for (uint32_t r = 0; r < repeats; r++)
+				{
+					Particle* particles = aos.ptr();
+					for (uint32_t i = 0; i < length; i++)
+					{
+						particles[i].position.x += particles[i].velocity.x * 0.016f;
+						particles[i].position.y += particles[i].velocity.y * 0.016f;
+						particles[i].life -= 0.016f;
+					}
+				}
+				const double aosUpdate = nsPer(time, static_cast<uint64_t>(repeats) * length);
+				time = Clock::now();
+				for (uint32_t r = 0; r < repeats; r++)
+				{
+					SelfTestVector* positions = soa.column<0>().ptr();
+					const SelfTestVector* velocities = soa.column<1>().ptr();
+					float* lives = soa.column<2>().ptr();
+					for (uint32_t i = 0; i < length; i++)
+					{
+						positions[i].x += velocities[i].x * 0.016f;
+						positions[i].y += velocities[i].y * 0.016f;
+						lives[i] -= 0.016f;
+					}
+				}
+				const double soaUpdate = nsPer(time, static_cast<uint64_t>(repeats) * length);
+
+				// Sums a single field.
+				uint64_t sink = 0;
+				time = Clock::now();
+				for (uint32_t r = 0; r < repeats; r++)
+				{
+					uint32_t sum = 0;
+					for (uint32_t i = 0; i < length; i++)
+						sum += aos[i].value;
+					sink += sum;
+				}
+				const double aosSum = nsPer(time, static_cast<uint64_t>(repeats) * length);
+				time = Clock::now();
+				for (uint32_t r = 0; r < repeats; r++)
+					sink += soa.column<3>().sum();
+				const double soaSum = nsPer(time, static_cast<uint64_t>(repeats) * length);
+				selfTestSink = sink + static_cast<uint64_t>(aos[0].position.x + soa.get<0>(0).x);
+
+				std::cout << length << " particles in ns per element: update aos " << aosUpdate << ", soa " << soaUpdate
+					<< " | value sum aos " << aosSum << ", soa " << soaSum << std::endl;
+			}
+		}
+		end();
+	}
+
+	// Gives every run of 16 keys a group of its own, so a run fills its group and erasing it leaves only deleted slots.
+	struct SelfTestGroupHash final
+	{
+		static uint64_t hash(const uint32_t key)
+		{
+			return (key & 0x7F) | static_cast<uint64_t>(key >> 4) << 7;
+		}
+		static bool equal(const uint32_t a, const uint32_t b)
+		{
+			return a == b;
+		}
+	};
+
+	void testMap(const bool benchmarks)
+	{
+		ArenaType types[] = { ArenaType::linear, ArenaType::tlsf };
+		uint64_t sizes[] = { 1 << 24, 1 << 18 };
+		Info info{};
+		info.persistentLength = 2;
+		info.persistentTypes = types;
+		info.persistentInitSizes = sizes;
+		init(info);
+
+		// Every round fills a group and erases all but one of its keys, as well as the key kept from 64 rounds ago.
+		// The map stays at 64 keys while deleted slots pile up, which have to be cleared out in place time after time.
+		const uint32_t ROUNDS = 4096;
+		const uint32_t KEPT = 64;
+		for (const ARENA arena : { PERN(0), PERN(1) })
+		{
+			auto arenaScope = manualScope(arena);
+			auto map = Map<uint32_t, uint32_t, SelfTestGroupHash>(arena, 1000);
+			const uint64_t pools = types[RPERN(arena)] == ArenaType::tlsf ? tlsfArenas[arena].GetTotalUsedMemory() : 0;
+
+			bool consistent = true;
+			for (uint32_t round = 0; round < ROUNDS; round++)
+			{
+				for (uint32_t i = 0; i < 16; i++)
+					map.insert(round * 16 + i) = round * 16 + i;
+				for (uint32_t i = 0; i < 15; i++)
+					map.erase(*map.contains(round * 16 + i));
+				if (round >= KEPT)
+				{
+					uint32_t* value = map.contains((round - KEPT) * 16 + 15);
+					consistent &= value && *value == (round - KEPT) * 16 + 15;
+					map.erase(*value);
+				}
+			}
+			uint32_t found = 0;
+			for (uint32_t key = 0; key < ROUNDS * 16; key++)
+			{
+				const uint32_t* value = map.contains(key);
+				const bool kept = key % 16 == 15 && key / 16 >= ROUNDS - KEPT;
+				consistent &= (value != nullptr) == kept && (!value || *value == key);
+				found += value != nullptr;
+			}
+			MEM_CHECK(consistent && found == KEPT && map.count() == KEPT);
+			if (types[RPERN(arena)] == ArenaType::tlsf)
+				MEM_CHECK(tlsfArenas[arena].GetTotalUsedMemory() == pools);
+			arenaScope.clear();
+		}
+
+		// Array keys match on their contents, not on where those are stored.
+		{
+			auto _ = scope(TEMP);
+			auto stored = Arr<char>(TEMP, 5);
+			auto lookup = Arr<char>(TEMP, 5);
+			memcpy(stored.ptr(), "hello", 5);
+			memcpy(lookup.ptr(), "hello", 5);
+			auto map = Map<uint32_t, Arr<char>>(TEMP, 4);
+			map.insert(stored) = 1;
+			const uint32_t* value = map.contains(lookup);
+			MEM_CHECK(value && *value == 1 && !map.contains(lookup.first(4)));
+		}
+		end();
+	}
+
+	uint32_t selfTest(const bool benchmarks)
+	{
+		selfTestFailures = 0;
+		testArenaChain(benchmarks);
+		testArenaSizes(benchmarks);
+		testConcurrentArena(benchmarks);
+		testTlsf(benchmarks);
+		testVec(benchmarks);
+		testMap(benchmarks);
+		testSort(benchmarks);
+		testRadixSort(benchmarks);
+		testParallelSort(benchmarks);
+		testSimd(benchmarks);
+		testSoA(benchmarks);
+		std::cout << "mem self test: " << selfTestFailures << " failed checks" << std::endl;
+		return selfTestFailures;
+	}
+}
+#endif
@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+
+namespace mem
+{
+	// Checks and benchmarks for the mem library, compiled in when MEM_SELFTEST is defined.
+	// Every section sets up mem the way it needs, so this has to run before mem::init.
+	// Returns the amount of failed checks. Benchmarks print their timings and can be skipped.
+	uint32_t selfTest(bool benchmarks = true);
+}
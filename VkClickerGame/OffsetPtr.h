@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+
+namespace mem
+{
+	// Pointer stored as a distance from itself, so it stays valid when the memory holding both ends is moved as a whole.
+	// Used for data in arenas that get saved to and loaded from snapshots. Can not be copied outside of that memory.
+	template <typename T>
+	struct OffsetPtr final {
+		OffsetPtr() = default;
+		OffsetPtr(T* ptr);
+		OffsetPtr(const OffsetPtr& other);
+		OffsetPtr& operator=(T* ptr);
+		OffsetPtr& operator=(const OffsetPtr& other);
+
+		[[nodiscard]] T* get() const;
+		T* operator->() const;
+		T& operator*() const;
+		T& operator[](uint64_t i) const;
+		explicit operator bool() const;
+	private:
+		// Zero is null, since a pointer pointing to itself is never useful.
+		int64_t _offset = 0;
+	};
+
+	template <typename T>
+	OffsetPtr<T>::OffsetPtr(T* ptr)
+	{
+		*this = ptr;
+	}
+
+	template <typename T>
+	OffsetPtr<T>::OffsetPtr(const OffsetPtr& other)
+	{
+		*this = other.get();
+	}
+
+	template <typename T>
+	OffsetPtr<T>& OffsetPtr<T>::operator=(T* ptr)
+	{
+		_offset = ptr ? reinterpret_cast<const char*>(ptr) - reinterpret_cast<const char*>(this) : 0;
+		return *this;
+	}
+
+	template <typename T>
+	OffsetPtr<T>& OffsetPtr<T>::operator=(const OffsetPtr& other)
+	{
+		return *this = other.get();
+	}
+
+	template <typename T>
+	T* OffsetPtr<T>::get() const
+	{
+		if (_offset == 0)
+			return nullptr;
+		return reinterpret_cast<T*>(const_cast<char*>(reinterpret_cast<const char*>(this)) + _offset);
+	}
+
+	template <typename T>
+	T* OffsetPtr<T>::operator->() const
+	{
+		return get();
+	}
+
+	template <typename T>
+	T& OffsetPtr<T>::operator*() const
+	{
+		return *get();
+	}
+
+	template <typename T>
+	T& OffsetPtr<T>::operator[](const uint64_t i) const
+	{
+		return get()[i];
+	}
+
+	template <typename T>
+	OffsetPtr<T>::operator bool() const
+	{
+		return _offset != 0;
+	}
+}
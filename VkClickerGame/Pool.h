@@ -0,0 +1,110 @@
+#pragma once
+#include "mem.h"
+
+namespace mem
+{
+	// Fixed size object pool that can remove objects in any order.
+	// Objects are carved out of cache line aligned slabs that are allocated from the arena when the pool runs out.
+	// Removed objects are recycled through a free list that is stored in the objects themselves.
+	// Like the rest of mem, destructors are not called.
+	template <typename T>
+	struct Pool final
+	{
+		Pool();
+		Pool(ARENA arena, uint32_t slabCapacity = 64);
+
+		T& add();
+		void remove(T& value);
+		// Removes all objects at once, the slabs are kept for reuse.
+		void clear();
+		uint32_t count() const;
+
+	private:
+		union Slot
+		{
+			alignas(T) char value[sizeof(T)];
+			Slot* next;
+		};
+
+		struct Slab final
+		{
+			Slab* next;
+			Slot* slots;
+		};
+
+		ARENA _arena = NONE;
+		uint32_t _slabCapacity = 0;
+		uint32_t _count = 0;
+		// Slots in the current slab that have been handed out. The ones past it have never been used.
+		uint32_t _used = 0;
+		Slab* _slabs = nullptr;
+		Slab* _current = nullptr;
+		Slot* _free = nullptr;
+
+		Slot* _newSlot();
+	};
+
+	template<typename T>
+	inline Pool<T>::Pool()
+	{
+	}
+	template<typename T>
+	inline Pool<T>::Pool(ARENA arena, uint32_t slabCapacity) : _arena(arena), _slabCapacity(slabCapacity)
+	{
+		assert(slabCapacity > 0);
+	}
+	template<typename T>
+	inline T& Pool<T>::add()
+	{
+		Slot* slot = _free;
+		if (slot)
+			_free = slot->next;
+		else
+			slot = _newSlot();
+		++_count;
+		return *new(slot->value) T();
+	}
+	template<typename T>
+	inline void Pool<T>::remove(T& value)
+	{
+		assert(_count > 0);
+		auto slot = reinterpret_cast<Slot*>(&value);
+		slot->next = _free;
+		_free = slot;
+		--_count;
+	}
+	template<typename T>
+	inline void Pool<T>::clear()
+	{
+		_current = _slabs;
+		_used = 0;
+		_free = nullptr;
+		_count = 0;
+	}
+	template<typename T>
+	inline uint32_t Pool<T>::count() const
+	{
+		return _count;
+	}
+	template<typename T>
+	inline typename Pool<T>::Slot* Pool<T>::_newSlot()
+	{
+		if (_current && _used < _slabCapacity)
+			return &_current->slots[_used++];
+
+		// Slabs that were kept after a clear get reused before allocating new ones.
+		Slab* next = _current ? _current->next : _slabs;
+		if (!next)
+		{
+			next = mem::alloc<Slab>(_arena);
+			next->slots = static_cast<Slot*>(manualAlloc(_arena, sizeof(Slot) * _slabCapacity, alignof(Slot) > 64 ? alignof(Slot) : 64));
+			if (_current)
+				_current->next = next;
+			else
+				_slabs = next;
+		}
+		_current = next;
+		_used = 1;
+		return &_current->slots[0];
+	}
+}
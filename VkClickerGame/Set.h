@@ -1,43 +1,51 @@
 #pragma once
 #include <cstdint>
 #include "Vec.h"
+#include "Map.h"
 
 namespace mem
 {
-	template <typename T>
+	// Keeps one value per key, stored contiguously in insertion order.
+	template <typename T, typename K = uint64_t, typename H = Hash<K>>
 	struct Set final {
 		Set(uint8_t arena, uint32_t length);
-		void insert(uint64_t key, T& value);
-		bool contains(uint64_t key, T& value);
+		void insert(const K& key, T& value);
+		// Copies the value stored for the key into value when it is found.
+		bool contains(const K& key, T& value);
 		Vec<T> vec();
 	private:
-		Arr<uint32_t> _set;
+		// Indices into the values.
+		Map<uint32_t, K, H> _indices;
 		Vec<T> _values;
 	};
 
-	template<typename T>
-	inline Set<T>::Set(uint8_t arena, uint32_t length)
+	template<typename T, typename K, typename H>
+	inline Set<T, K, H>::Set(uint8_t arena, uint32_t length)
 	{
-		_set = Arr<uint32_t>(arena, length);
-		_set.set(-1);
+		_indices = Map<uint32_t, K, H>(arena, length);
 		_values = Vec<T>(arena, length);
 	}
-	template<typename T>
-	inline void Set<T>::insert(uint64_t key, T& value)
+	template<typename T, typename K, typename H>
+	inline void Set<T, K, H>::insert(const K& key, T& value)
 	{
-		if (contains(key, value))
+		if (_indices.contains(key))
 			return;
-		_set[key] = true;
+		_indices.insert(key) = _values.count();
 		_values.add() = value;
 	}
-	template<typename T>
-	inline bool Set<T>::contains(uint64_t key, T& value)
+	template<typename T, typename K, typename H>
+	inline bool Set<T, K, H>::contains(const K& key, T& value)
 	{
-		return _set[key] != -1;
+		const uint32_t* index = _indices.contains(key);
+		if (!index)
+			return false;
+		value = _values[*index];
+		return true;
 	}
-	template<typename T>
-	inline Vec<T> Set<T>::vec()
+	template<typename T, typename K, typename H>
+	inline Vec<T> Set<T, K, H>::vec()
 	{
 		return _values;
 	}
 }
+
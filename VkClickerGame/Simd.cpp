@@ -0,0 +1,762 @@
+#include "pch.h"
+#include "Simd.h"
+#include <cstring>
+#if defined(_M_X64) || defined(__x86_64__)
+#define MEM_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC allows AVX2 intrinsics in any function.
+#define MEM_AVX2
+#else
+#define MEM_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#ifdef MEM_SIMD_X86
+#define MEM_SIMD_DISPATCH(kernel, ...) \
+	if (simdHasAvx2()) \
+		return avx2##kernel(__VA_ARGS__); \
+	return sse2##kernel(__VA_ARGS__)
+#else
+#define MEM_SIMD_DISPATCH(kernel, ...) return scalar##kernel(__VA_ARGS__)
+#endif
+
+namespace mem
+{
+	namespace
+	{
+		struct MinOp final {};
+		struct MaxOp final {};
+		struct SumOp final {};
+
+		uint32_t lowestBit(const uint32_t mask)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return index;
+#else
+			return __builtin_ctz(mask);
+#endif
+		}
+
+		template <typename T>
+		T scalarApply(const T a, const T b, MinOp)
+		{
+			return b < a ? b : a;
+		}
+		template <typename T>
+		T scalarApply(const T a, const T b, MaxOp)
+		{
+			return a < b ? b : a;
+		}
+		template <typename T>
+		T scalarApply(const T a, const T b, SumOp)
+		{
+			return a + b;
+		}
+		int32_t scalarApply(const int32_t a, const int32_t b, SumOp)
+		{
+			// Signed overflow is undefined, so the wrap around happens on unsigned values.
+			return static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+		}
+
+		template <typename T>
+		void scalarFill(T* ptr, const uint64_t length, const T value)
+		{
+			for (uint64_t i = 0; i < length; i++)
+				ptr[i] = value;
+		}
+		template <typename T>
+		int64_t scalarFind(const T* ptr, const uint64_t start, const uint64_t length, const T value)
+		{
+			for (uint64_t i = start; i < length; i++)
+				if (ptr[i] == value)
+					return static_cast<int64_t>(i);
+			return -1;
+		}
+		template <typename T>
+		int64_t scalarFind(const T* ptr, const uint64_t length, const T value)
+		{
+			return scalarFind(ptr, 0, length, value);
+		}
+		template <typename T>
+		uint64_t scalarCount(const T* ptr, const uint64_t start, const uint64_t length, const T value)
+		{
+			uint64_t count = 0;
+			for (uint64_t i = start; i < length; i++)
+				count += ptr[i] == value;
+			return count;
+		}
+		template <typename T>
+		uint64_t scalarCount(const T* ptr, const uint64_t length, const T value)
+		{
+			return scalarCount(ptr, 0, length, value);
+		}
+		template <typename T>
+		uint64_t scalarCompress(T* dst, const T* src, const uint8_t* keep, const uint64_t length, const uint64_t capacity)
+		{
+			uint64_t n = 0;
+			for (uint64_t i = 0; i < length && n < capacity; i++)
+			{
+				dst[n] = src[i];
+				n += keep[i] != 0;
+			}
+			return n;
+		}
+		template <typename T, typename Op>
+		T scalarReduce(const T* ptr, const uint64_t length, Op op)
+		{
+			T result = ptr[0];
+			for (uint64_t i = 1; i < length; i++)
+				result = scalarApply(result, ptr[i], op);
+			return result;
+		}
+
+#ifdef MEM_SIMD_X86
+		// Lane orders that move the kept elements of a vector to its front.
+		struct CompressTables final
+		{
+			uint8_t lanes32[256][8];
+			uint8_t lanes64[16][8];
+			uint8_t counts[256];
+
+			CompressTables()
+			{
+				memset(this, 0, sizeof(CompressTables));
+				for (uint32_t mask = 0; mask < 256; mask++)
+				{
+					uint8_t n = 0;
+					for (uint8_t i = 0; i < 8; i++)
+						if (mask & (1u << i))
+						{
+							lanes32[mask][n++] = i;
+							if (mask < 16)
+							{
+								lanes64[mask][n * 2 - 2] = i * 2;
+								lanes64[mask][n * 2 - 1] = i * 2 + 1;
+							}
+						}
+					counts[mask] = n;
+				}
+			}
+		};
+		const CompressTables& compressTables()
+		{
+			static const CompressTables tables;
+			return tables;
+		}
+
+		__m128i sse2Set1(const uint8_t value)
+		{
+			return _mm_set1_epi8(static_cast<char>(value));
+		}
+		__m128i sse2Set1(const uint16_t value)
+		{
+			return _mm_set1_epi16(static_cast<short>(value));
+		}
+		__m128i sse2Set1(const uint32_t value)
+		{
+			return _mm_set1_epi32(static_cast<int>(value));
+		}
+		__m128i sse2Set1(const uint64_t value)
+		{
+			return _mm_set1_epi64x(static_cast<long long>(value));
+		}
+		__m128 sse2Set1(const float value)
+		{
+			return _mm_set1_ps(value);
+		}
+		__m128d sse2Set1(const double value)
+		{
+			return _mm_set1_pd(value);
+		}
+
+		// Matching elements have all their bytes set.
+		__m128i sse2Eq(const uint8_t* ptr, const __m128i value)
+		{
+			return _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)), value);
+		}
+		__m128i sse2Eq(const uint16_t* ptr, const __m128i value)
+		{
+			return _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)), value);
+		}
+		__m128i sse2Eq(const uint32_t* ptr, const __m128i value)
+		{
+			return _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)), value);
+		}
+		__m128i sse2Eq(const uint64_t* ptr, const __m128i value)
+		{
+			// SSE2 has no 64 bit compare, so both halves have to match.
+			const __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)), value);
+			return _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+		}
+		__m128i sse2Eq(const float* ptr, const __m128 value)
+		{
+			return _mm_castps_si128(_mm_cmpeq_ps(_mm_loadu_ps(ptr), value));
+		}
+		__m128i sse2Eq(const double* ptr, const __m128d value)
+		{
+			return _mm_castpd_si128(_mm_cmpeq_pd(_mm_loadu_pd(ptr), value));
+		}
+
+		__m128i sse2Load(const int32_t* ptr)
+		{
+			return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+		}
+		__m128i sse2Load(const uint32_t* ptr)
+		{
+			return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+		}
+		__m128 sse2Load(const float* ptr)
+		{
+			return _mm_loadu_ps(ptr);
+		}
+		__m128d sse2Load(const double* ptr)
+		{
+			return _mm_loadu_pd(ptr);
+		}
+		template <typename T>
+		void sse2Store(T* ptr, const __m128i value)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), value);
+		}
+		void sse2Store(float* ptr, const __m128 value)
+		{
+			_mm_storeu_ps(ptr, value);
+		}
+		void sse2Store(double* ptr, const __m128d value)
+		{
+			_mm_storeu_pd(ptr, value);
+		}
+
+		__m128i sse2Select(const __m128i mask, const __m128i a, const __m128i b)
+		{
+			return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+		}
+		__m128i sse2Apply(const __m128i a, const __m128i b, int32_t, MinOp)
+		{
+			return sse2Select(_mm_cmpgt_epi32(a, b), b, a);
+		}
+		__m128i sse2Apply(const __m128i a, const __m128i b, int32_t, MaxOp)
+		{
+			return sse2Select(_mm_cmpgt_epi32(a, b), a, b);
+		}
+		// Unsigned compares are done as signed compares with the sign bits flipped.
+		__m128i sse2Apply(const __m128i a, const __m128i b, uint32_t, MinOp)
+		{
+			const __m128i sign = _mm_set1_epi32(static_cast<int>(0x80000000u));
+			return sse2Select(_mm_cmpgt_epi32(_mm_xor_si128(a, sign), _mm_xor_si128(b, sign)), b, a);
+		}
+		__m128i sse2Apply(const __m128i a, const __m128i b, uint32_t, MaxOp)
+		{
+			const __m128i sign = _mm_set1_epi32(static_cast<int>(0x80000000u));
+			return sse2Select(_mm_cmpgt_epi32(_mm_xor_si128(a, sign), _mm_xor_si128(b, sign)), a, b);
+		}
+		template <typename T>
+		__m128i sse2Apply(const __m128i a, const __m128i b, T, SumOp)
+		{
+			return _mm_add_epi32(a, b);
+		}
+		__m128 sse2Apply(const __m128 a, const __m128 b, float, MinOp)
+		{
+			return _mm_min_ps(a, b);
+		}
+		__m128 sse2Apply(const __m128 a, const __m128 b, float, MaxOp)
+		{
+			return _mm_max_ps(a, b);
+		}
+		__m128 sse2Apply(const __m128 a, const __m128 b, float, SumOp)
+		{
+			return _mm_add_ps(a, b);
+		}
+		__m128d sse2Apply(const __m128d a, const __m128d b, double, MinOp)
+		{
+			return _mm_min_pd(a, b);
+		}
+		__m128d sse2Apply(const __m128d a, const __m128d b, double, MaxOp)
+		{
+			return _mm_max_pd(a, b);
+		}
+		__m128d sse2Apply(const __m128d a, const __m128d b, double, SumOp)
+		{
+			return _mm_add_pd(a, b);
+		}
+
+		template <typename T>
+		void sse2Fill(T* ptr, const uint64_t length, const T value)
+		{
+			constexpr uint64_t lanes = 16 / sizeof(T);
+			const __m128i v = sse2Set1(value);
+			uint64_t i = 0;
+			for (; i + lanes <= length; i += lanes)
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&ptr[i]), v);
+			for (; i < length; i++)
+				ptr[i] = value;
+		}
+		template <typename T>
+		int64_t sse2Find(const T* ptr, const uint64_t length, const T value)
+		{
+			constexpr uint64_t lanes = 16 / sizeof(T);
+			const auto v = sse2Set1(value);
+			uint64_t i = 0;
+			for (; i + lanes <= length; i += lanes)
+				if (const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(sse2Eq(&ptr[i], v))))
+					return static_cast<int64_t>(i + lowestBit(mask) / sizeof(T));
+			return scalarFind(ptr, i, length, value);
+		}
+		template <typename T>
+		uint64_t sse2Count(const T* ptr, const uint64_t length, const T value)
+		{
+			// Every match subtracts -1 from sizeof(T) byte counters, which are summed up before they can overflow.
+			constexpr uint64_t lanes = 16 / sizeof(T);
+			const auto v = sse2Set1(value);
+			const __m128i zero = _mm_setzero_si128();
+			__m128i total = zero;
+			uint64_t i = 0;
+			while (i + lanes <= length)
+			{
+				__m128i bytes = zero;
+				for (uint32_t j = 0; j < 255 && i + lanes <= length; j++, i += lanes)
+					bytes = _mm_sub_epi8(bytes, sse2Eq(&ptr[i], v));
+				total = _mm_add_epi64(total, _mm_sad_epu8(bytes, zero));
+			}
+			uint64_t sums[2];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(sums), total);
+			return (sums[0] + sums[1]) / sizeof(T) + scalarCount(ptr, i, length, value);
+		}
+		// SSE2 has no variable shuffle, so it gets the branchless scalar loop.
+		template <typename T>
+		uint64_t sse2Compress(T* dst, const T* src, const uint8_t* keep, const uint64_t length, const uint64_t capacity)
+		{
+			return scalarCompress(dst, src, keep, length, capacity);
+		}
+		template <typename T, typename Op>
+		T sse2Reduce(const T* ptr, const uint64_t length, Op op)
+		{
+			constexpr uint64_t lanes = 16 / sizeof(T);
+			if (length < lanes * 4)
+				return scalarReduce(ptr, length, op);
+
+			// Separate accumulators hide the latency of the operation.
+			auto acc0 = sse2Load(&ptr[0]);
+			auto acc1 = sse2Load(&ptr[lanes]);
+			auto acc2 = sse2Load(&ptr[lanes * 2]);
+			auto acc3 = sse2Load(&ptr[lanes * 3]);
+			uint64_t i = lanes * 4;
+			for (; i + lanes * 4 <= length; i += lanes * 4)
+			{
+				acc0 = sse2Apply(acc0, sse2Load(&ptr[i]), T(), op);
+				acc1 = sse2Apply(acc1, sse2Load(&ptr[i + lanes]), T(), op);
+				acc2 = sse2Apply(acc2, sse2Load(&ptr[i + lanes * 2]), T(), op);
+				acc3 = sse2Apply(acc3, sse2Load(&ptr[i + lanes * 3]), T(), op);
+			}
+			acc0 = sse2Apply(sse2Apply(acc0, acc1, T(), op), sse2Apply(acc2, acc3, T(), op), T(), op);
+
+			T lanesOut[lanes];
+			sse2Store(lanesOut, acc0);
+			T result = lanesOut[0];
+			for (uint64_t j = 1; j < lanes; j++)
+				result = scalarApply(result, lanesOut[j], op);
+			for (; i < length; i++)
+				result = scalarApply(result, ptr[i], op);
+			return result;
+		}
+
+		MEM_AVX2 __m256i avx2Set1(const uint8_t value)
+		{
+			return _mm256_set1_epi8(static_cast<char>(value));
+		}
+		MEM_AVX2 __m256i avx2Set1(const uint16_t value)
+		{
+			return _mm256_set1_epi16(static_cast<short>(value));
+		}
+		MEM_AVX2 __m256i avx2Set1(const uint32_t value)
+		{
+			return _mm256_set1_epi32(static_cast<int>(value));
+		}
+		MEM_AVX2 __m256i avx2Set1(const uint64_t value)
+		{
+			return _mm256_set1_epi64x(static_cast<long long>(value));
+		}
+		MEM_AVX2 __m256 avx2Set1(const float value)
+		{
+			return _mm256_set1_ps(value);
+		}
+		MEM_AVX2 __m256d avx2Set1(const double value)
+		{
+			return _mm256_set1_pd(value);
+		}
+
+		MEM_AVX2 __m256i avx2Eq(const uint8_t* ptr, const __m256i value)
+		{
+			return _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr)), value);
+		}
+		MEM_AVX2 __m256i avx2Eq(const uint16_t* ptr, const __m256i value)
+		{
+			return _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr)), value);
+		}
+		MEM_AVX2 __m256i avx2Eq(const uint32_t* ptr, const __m256i value)
+		{
+			return _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr)), value);
+		}
+		MEM_AVX2 __m256i avx2Eq(const uint64_t* ptr, const __m256i value)
+		{
+			return _mm256_cmpeq_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr)), value);
+		}
+		MEM_AVX2 __m256i avx2Eq(const float* ptr, const __m256 value)
+		{
+			return _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(ptr), value, _CMP_EQ_OQ));
+		}
+		MEM_AVX2 __m256i avx2Eq(const double* ptr, const __m256d value)
+		{
+			return _mm256_castpd_si256(_mm256_cmp_pd(_mm256_loadu_pd(ptr), value, _CMP_EQ_OQ));
+		}
+
+		MEM_AVX2 __m256i avx2Load(const int32_t* ptr)
+		{
+			return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+		}
+		MEM_AVX2 __m256i avx2Load(const uint32_t* ptr)
+		{
+			return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+		}
+		MEM_AVX2 __m256 avx2Load(const float* ptr)
+		{
+			return _mm256_loadu_ps(ptr);
+		}
+		MEM_AVX2 __m256d avx2Load(const double* ptr)
+		{
+			return _mm256_loadu_pd(ptr);
+		}
+		template <typename T>
+		MEM_AVX2 void avx2Store(T* ptr, const __m256i value)
+		{
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(ptr), value);
+		}
+		MEM_AVX2 void avx2Store(float* ptr, const __m256 value)
+		{
+			_mm256_storeu_ps(ptr, value);
+		}
+		MEM_AVX2 void avx2Store(double* ptr, const __m256d value)
+		{
+			_mm256_storeu_pd(ptr, value);
+		}
+
+		MEM_AVX2 __m256i avx2Apply(const __m256i a, const __m256i b, int32_t, MinOp)
+		{
+			return _mm256_min_epi32(a, b);
+		}
+		MEM_AVX2 __m256i avx2Apply(const __m256i a, const __m256i b, int32_t, MaxOp)
+		{
+			return _mm256_max_epi32(a, b);
+		}
+		MEM_AVX2 __m256i avx2Apply(const __m256i a, const __m256i b, uint32_t, MinOp)
+		{
+			return _mm256_min_epu32(a, b);
+		}
+		MEM_AVX2 __m256i avx2Apply(const __m256i a, const __m256i b, uint32_t, MaxOp)
+		{
+			return _mm256_max_epu32(a, b);
+		}
+		template <typename T>
+		MEM_AVX2 __m256i avx2Apply(const __m256i a, const __m256i b, T, SumOp)
+		{
+			return _mm256_add_epi32(a, b);
+		}
+		MEM_AVX2 __m256 avx2Apply(const __m256 a, const __m256 b, float, MinOp)
+		{
+			return _mm256_min_ps(a, b);
+		}
+		MEM_AVX2 __m256 avx2Apply(const __m256 a, const __m256 b, float, MaxOp)
+		{
+			return _mm256_max_ps(a, b);
+		}
+		MEM_AVX2 __m256 avx2Apply(const __m256 a, const __m256 b, float, SumOp)
+		{
+			return _mm256_add_ps(a, b);
+		}
+		MEM_AVX2 __m256d avx2Apply(const __m256d a, const __m256d b, double, MinOp)
+		{
+			return _mm256_min_pd(a, b);
+		}
+		MEM_AVX2 __m256d avx2Apply(const __m256d a, const __m256d b, double, MaxOp)
+		{
+			return _mm256_max_pd(a, b);
+		}
+		MEM_AVX2 __m256d avx2Apply(const __m256d a, const __m256d b, double, SumOp)
+		{
+			return _mm256_add_pd(a, b);
+		}
+
+		template <typename T>
+		MEM_AVX2 void avx2Fill(T* ptr, const uint64_t length, const T value)
+		{
+			constexpr uint64_t lanes = 32 / sizeof(T);
+			const __m256i v = avx2Set1(value);
+			uint64_t i = 0;
+			for (; i + lanes <= length; i += lanes)
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(&ptr[i]), v);
+			for (; i < length; i++)
+				ptr[i] = value;
+		}
+		template <typename T>
+		MEM_AVX2 int64_t avx2Find(const T* ptr, const uint64_t length, const T value)
+		{
+			constexpr uint64_t lanes = 32 / sizeof(T);
+			const auto v = avx2Set1(value);
+			uint64_t i = 0;
+			for (; i + lanes <= length; i += lanes)
+				if (const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(avx2Eq(&ptr[i], v))))
+					return static_cast<int64_t>(i + lowestBit(mask) / sizeof(T));
+			return scalarFind(ptr, i, length, value);
+		}
+		template <typename T>
+		MEM_AVX2 uint64_t avx2Count(const T* ptr, const uint64_t length, const T value)
+		{
+			constexpr uint64_t lanes = 32 / sizeof(T);
+			const auto v = avx2Set1(value);
+			const __m256i zero = _mm256_setzero_si256();
+			__m256i total = zero;
+			uint64_t i = 0;
+			while (i + lanes <= length)
+			{
+				__m256i bytes = zero;
+				for (uint32_t j = 0; j < 255 && i + lanes <= length; j++, i += lanes)
+					bytes = _mm256_sub_epi8(bytes, avx2Eq(&ptr[i], v));
+				total = _mm256_add_epi64(total, _mm256_sad_epu8(bytes, zero));
+			}
+			uint64_t sums[4];
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(sums), total);
+			return (sums[0] + sums[1] + sums[2] + sums[3]) / sizeof(T) + scalarCount(ptr, i, length, value);
+		}
+		// Every store writes a whole vector, so it stays behind the loads when dst overlaps src,
+		// and the loop stops once a whole vector no longer fits into dst.
+		MEM_AVX2 uint64_t avx2Compress(uint32_t* dst, const uint32_t* src, const uint8_t* keep, const uint64_t length, const uint64_t capacity)
+		{
+			const CompressTables& tables = compressTables();
+			const __m128i zero = _mm_setzero_si128();
+			uint64_t n = 0;
+			uint64_t i = 0;
+			for (; i + 8 <= length && n + 8 <= capacity; i += 8)
+			{
+				const __m128i k = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&keep[i]));
+				const uint32_t mask = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(k, zero))) & 0xFF;
+				const __m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(tables.lanes32[mask])));
+				const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i]));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[n]), _mm256_permutevar8x32_epi32(v, lanes));
+				n += tables.counts[mask];
+			}
+			return n + scalarCompress(&dst[n], &src[i], &keep[i], length - i, capacity - n);
+		}
+		MEM_AVX2 uint64_t avx2Compress(uint64_t* dst, const uint64_t* src, const uint8_t* keep, const uint64_t length, const uint64_t capacity)
+		{
+			const CompressTables& tables = compressTables();
+			const __m128i zero = _mm_setzero_si128();
+			uint64_t n = 0;
+			uint64_t i = 0;
+			for (; i + 4 <= length && n + 4 <= capacity; i += 4)
+			{
+				int32_t k;
+				memcpy(&k, &keep[i], sizeof(int32_t));
+				const uint32_t mask = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_cvtsi32_si128(k), zero))) & 0xF;
+				const __m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(tables.lanes64[mask])));
+				const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i]));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[n]), _mm256_permutevar8x32_epi32(v, lanes));
+				n += tables.counts[mask];
+			}
+			return n + scalarCompress(&dst[n], &src[i], &keep[i], length - i, capacity - n);
+		}
+		template <typename T, typename Op>
+		MEM_AVX2 T avx2Reduce(const T* ptr, const uint64_t length, Op op)
+		{
+			constexpr uint64_t lanes = 32 / sizeof(T);
+			if (length < lanes * 4)
+				return scalarReduce(ptr, length, op);
+
+			auto acc0 = avx2Load(&ptr[0]);
+			auto acc1 = avx2Load(&ptr[lanes]);
+			auto acc2 = avx2Load(&ptr[lanes * 2]);
+			auto acc3 = avx2Load(&ptr[lanes * 3]);
+			uint64_t i = lanes * 4;
+			for (; i + lanes * 4 <= length; i += lanes * 4)
+			{
+				acc0 = avx2Apply(acc0, avx2Load(&ptr[i]), T(), op);
+				acc1 = avx2Apply(acc1, avx2Load(&ptr[i + lanes]), T(), op);
+				acc2 = avx2Apply(acc2, avx2Load(&ptr[i + lanes * 2]), T(), op);
+				acc3 = avx2Apply(acc3, avx2Load(&ptr[i + lanes * 3]), T(), op);
+			}
+			acc0 = avx2Apply(avx2Apply(acc0, acc1, T(), op), avx2Apply(acc2, acc3, T(), op), T(), op);
+
+			T lanesOut[lanes];
+			avx2Store(lanesOut, acc0);
+			T result = lanesOut[0];
+			for (uint64_t j = 1; j < lanes; j++)
+				result = scalarApply(result, lanesOut[j], op);
+			for (; i < length; i++)
+				result = scalarApply(result, ptr[i], op);
+			return result;
+		}
+#endif
+	}
+
+	bool simdHasAvx2()
+	{
+#ifdef MEM_SIMD_X86
+#ifdef _MSC_VER
+		static const bool avx2 = []
+		{
+			int regs[4];
+			__cpuid(regs, 1);
+			// The OS has to save the AVX registers on context switches as well.
+			const bool osxsave = (regs[2] & (1 << 27)) != 0;
+			const bool avx = (regs[2] & (1 << 28)) != 0;
+			if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+				return false;
+			__cpuidex(regs, 7, 0);
+			return (regs[1] & (1 << 5)) != 0;
+		}();
+#else
+		static const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+		return avx2;
+#else
+		return false;
+#endif
+	}
+
+	void simdFill(uint8_t* ptr, const uint64_t length, const uint8_t value)
+	{
+		memset(ptr, value, length);
+	}
+	void simdFill(uint16_t* ptr, const uint64_t length, const uint16_t value)
+	{
+		MEM_SIMD_DISPATCH(Fill, ptr, length, value);
+	}
+	void simdFill(uint32_t* ptr, const uint64_t length, const uint32_t value)
+	{
+		MEM_SIMD_DISPATCH(Fill, ptr, length, value);
+	}
+	void simdFill(uint64_t* ptr, const uint64_t length, const uint64_t value)
+	{
+		MEM_SIMD_DISPATCH(Fill, ptr, length, value);
+	}
+
+	int64_t simdFind(const uint8_t* ptr, const uint64_t length, const uint8_t value)
+	{
+		MEM_SIMD_DISPATCH(Find, ptr, length, value);
+	}
+	int64_t simdFind(const uint16_t* ptr, const uint64_t length, const uint16_t value)
+	{
+		MEM_SIMD_DISPATCH(Find, ptr, length, value);
+	}
+	int64_t simdFind(const uint32_t* ptr, const uint64_t length, const uint32_t value)
+	{
+		MEM_SIMD_DISPATCH(Find, ptr, length, value);
+	}
+	int64_t simdFind(const uint64_t* ptr, const uint64_t length, const uint64_t value)
+	{
+		MEM_SIMD_DISPATCH(Find, ptr, length, value);
+	}
+	int64_t simdFind(const float* ptr, const uint64_t length, const float value)
+	{
+		MEM_SIMD_DISPATCH(Find, ptr, length, value);
+	}
+	int64_t simdFind(const double* ptr, const uint64_t length, const double value)
+	{
+		MEM_SIMD_DISPATCH(Find, ptr, length, value);
+	}
+
+	uint64_t simdCount(const uint8_t* ptr, const uint64_t length, const uint8_t value)
+	{
+		MEM_SIMD_DISPATCH(Count, ptr, length, value);
+	}
+	uint64_t simdCount(const uint16_t* ptr, const uint64_t length, const uint16_t value)
+	{
+		MEM_SIMD_DISPATCH(Count, ptr, length, value);
+	}
+	uint64_t simdCount(const uint32_t* ptr, const uint64_t length, const uint32_t value)
+	{
+		MEM_SIMD_DISPATCH(Count, ptr, length, value);
+	}
+	uint64_t simdCount(const uint64_t* ptr, const uint64_t length, const uint64_t value)
+	{
+		MEM_SIMD_DISPATCH(Count, ptr, length, value);
+	}
+	uint64_t simdCount(const float* ptr, const uint64_t length, const float value)
+	{
+		MEM_SIMD_DISPATCH(Count, ptr, length, value);
+	}
+	uint64_t simdCount(const double* ptr, const uint64_t length, const double value)
+	{
+		MEM_SIMD_DISPATCH(Count, ptr, length, value);
+	}
+
+	int32_t simdMin(const int32_t* ptr, const uint64_t length)
+	{
+		MEM_SIMD_DISPATCH(Reduce, ptr, length, MinOp());
+	}
+	uint32_t simdMin(const uint32_t* ptr, const uint64_t length)
+	{
+		MEM_SIMD_DISPATCH(Reduce, ptr, length, MinOp());
+	}
+	float simdMin(const float* ptr, const uint64_t length)
+	{
+		MEM_SIMD_DISPATCH(Reduce, ptr, length, MinOp());
+	}
+	double simdMin(const double* ptr, const uint64_t length)
+	{
+		MEM_SIMD_DISPATCH(Reduce, ptr, length, MinOp());
+	}
+	int32_t simdMax(const int32_t* ptr, const uint64_t length)
+	{
+		MEM_SIMD_DISPATCH(Reduce, ptr, length, MaxOp());
+	}
+	uint32_t simdMax(const uint32_t* ptr, const uint64_t length)
+	{
+		MEM_SIMD_DISPATCH(Reduce, ptr, length, MaxOp());
+	}
+	float simdMax(const float* ptr, const uint64_t length)
+	{
+		MEM_SIMD_DISPATCH(Reduce, ptr, length, MaxOp());
+	}
+	double simdMax(const double* ptr, const uint64_t length)
+	{
+		MEM_SIMD_DISPATCH(Reduce, ptr, length, MaxOp());
+	}
+
+	int32_t simdSum(const int32_t* ptr, const uint64_t length)
+	{
+		if (length == 0)
+			return 0;
+		MEM_SIMD_DISPATCH(Reduce, ptr, length, SumOp());
+	}
+	uint32_t simdSum(const uint32_t* ptr, const uint64_t length)
+	{
+		if (length == 0)
+			return 0;
+		MEM_SIMD_DISPATCH(Reduce, ptr, length, SumOp());
+	}
+	float simdSum(const float* ptr, const uint64_t length)
+	{
+		if (length == 0)
+			return 0;
+		MEM_SIMD_DISPATCH(Reduce, ptr, length, SumOp());
+	}
+	double simdSum(const double* ptr, const uint64_t length)
+	{
+		if (length == 0)
+			return 0;
+		MEM_SIMD_DISPATCH(Reduce, ptr, length, SumOp());
+	}
+
+	uint64_t simdCompress(uint32_t* dst, const uint32_t* src, const uint8_t* keep, const uint64_t length, const uint64_t capacity)
+	{
+		MEM_SIMD_DISPATCH(Compress, dst, src, keep, length, capacity);
+	}
+	uint64_t simdCompress(uint64_t* dst, const uint64_t* src, const uint8_t* keep, const uint64_t length, const uint64_t capacity)
+	{
+		MEM_SIMD_DISPATCH(Compress, dst, src, keep, length, capacity);
+	}
+}
@@ -0,0 +1,272 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace mem
+{
+	// Vectorized kernels behind the bulk operations of Arr. On x86-64 they use AVX2 when the cpu supports it and SSE2
+	// otherwise, which is checked once at runtime. Other platforms get scalar loops.
+	// Integer versions compare bits, so they also serve enums, pointers and other types of the same size.
+
+	[[nodiscard]] bool simdHasAvx2();
+
+	void simdFill(uint8_t* ptr, uint64_t length, uint8_t value);
+	void simdFill(uint16_t* ptr, uint64_t length, uint16_t value);
+	void simdFill(uint32_t* ptr, uint64_t length, uint32_t value);
+	void simdFill(uint64_t* ptr, uint64_t length, uint64_t value);
+
+	// Returns the index of the first match, or -1.
+	[[nodiscard]] int64_t simdFind(const uint8_t* ptr, uint64_t length, uint8_t value);
+	[[nodiscard]] int64_t simdFind(const uint16_t* ptr, uint64_t length, uint16_t value);
+	[[nodiscard]] int64_t simdFind(const uint32_t* ptr, uint64_t length, uint32_t value);
+	[[nodiscard]] int64_t simdFind(const uint64_t* ptr, uint64_t length, uint64_t value);
+	[[nodiscard]] int64_t simdFind(const float* ptr, uint64_t length, float value);
+	[[nodiscard]] int64_t simdFind(const double* ptr, uint64_t length, double value);
+
+	[[nodiscard]] uint64_t simdCount(const uint8_t* ptr, uint64_t length, uint8_t value);
+	[[nodiscard]] uint64_t simdCount(const uint16_t* ptr, uint64_t length, uint16_t value);
+	[[nodiscard]] uint64_t simdCount(const uint32_t* ptr, uint64_t length, uint32_t value);
+	[[nodiscard]] uint64_t simdCount(const uint64_t* ptr, uint64_t length, uint64_t value);
+	[[nodiscard]] uint64_t simdCount(const float* ptr, uint64_t length, float value);
+	[[nodiscard]] uint64_t simdCount(const double* ptr, uint64_t length, double value);
+
+	// Length has to be above zero. NaNs give an unspecified result.
+	[[nodiscard]] int32_t simdMin(const int32_t* ptr, uint64_t length);
+	[[nodiscard]] uint32_t simdMin(const uint32_t* ptr, uint64_t length);
+	[[nodiscard]] float simdMin(const float* ptr, uint64_t length);
+	[[nodiscard]] double simdMin(const double* ptr, uint64_t length);
+	[[nodiscard]] int32_t simdMax(const int32_t* ptr, uint64_t length);
+	[[nodiscard]] uint32_t simdMax(const uint32_t* ptr, uint64_t length);
+	[[nodiscard]] float simdMax(const float* ptr, uint64_t length);
+	[[nodiscard]] double simdMax(const double* ptr, uint64_t length);
+
+	// Integer sums wrap around. Floating point sums are added in a different order than a scalar loop would,
+	// so the result can differ in the last bits.
+	[[nodiscard]] int32_t simdSum(const int32_t* ptr, uint64_t length);
+	[[nodiscard]] uint32_t simdSum(const uint32_t* ptr, uint64_t length);
+	[[nodiscard]] float simdSum(const float* ptr, uint64_t length);
+	[[nodiscard]] double simdSum(const double* ptr, uint64_t length);
+
+	// Copies the elements with a nonzero keep byte to dst in order, and returns how many there were.
+	// Dst can overlap src as long as it does not start after it. Capacity is the number of elements dst can hold,
+	// and has to be at least the number of kept elements.
+	[[nodiscard]] uint64_t simdCompress(uint32_t* dst, const uint32_t* src, const uint8_t* keep, uint64_t length, uint64_t capacity);
+	[[nodiscard]] uint64_t simdCompress(uint64_t* dst, const uint64_t* src, const uint8_t* keep, uint64_t length, uint64_t capacity);
+
+	template <uint32_t S>
+	struct p_SimdBits final {};
+	template <>
+	struct p_SimdBits<1> final { using Type = uint8_t; };
+	template <>
+	struct p_SimdBits<2> final { using Type = uint16_t; };
+	template <>
+	struct p_SimdBits<4> final { using Type = uint32_t; };
+	template <>
+	struct p_SimdBits<8> final { using Type = uint64_t; };
+
+	// Types whose equality is the same as equality of their bits.
+	template <typename T>
+	struct p_SimdBitwise final : std::integral_constant<bool,
+		(std::is_integral<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value) &&
+		(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8)> {};
+	template <typename T>
+	struct p_SimdElement final : std::integral_constant<bool,
+		p_SimdBitwise<T>::value || std::is_same<T, float>::value || std::is_same<T, double>::value> {};
+
+	template <typename T>
+	void p_fill(T* ptr, uint32_t length, const T& value, std::false_type);
+	template <typename T>
+	void p_fill(T* ptr, uint32_t length, const T& value, std::true_type);
+	template <typename T>
+	[[nodiscard]] int64_t p_find(const T* ptr, uint32_t length, const T& value, std::false_type);
+	template <typename T>
+	[[nodiscard]] int64_t p_find(const T* ptr, uint32_t length, const T& value, std::true_type);
+	template <typename T>
+	[[nodiscard]] uint64_t p_count(const T* ptr, uint32_t length, const T& value, std::false_type);
+	template <typename T>
+	[[nodiscard]] uint64_t p_count(const T* ptr, uint32_t length, const T& value, std::true_type);
+	template <typename T>
+	[[nodiscard]] uint32_t p_compress(T* dst, const T* src, const uint8_t* keep, uint32_t length, uint32_t capacity, std::false_type);
+	template <typename T>
+	[[nodiscard]] uint32_t p_compress(T* dst, const T* src, const uint8_t* keep, uint32_t length, uint32_t capacity, std::true_type);
+	template <typename T>
+	[[nodiscard]] uint32_t p_compressPod(T* dst, const T* src, const uint8_t* keep, uint32_t length, uint32_t capacity, std::false_type);
+	template <typename T>
+	[[nodiscard]] uint32_t p_compressPod(T* dst, const T* src, const uint8_t* keep, uint32_t length, uint32_t capacity, std::true_type);
+	template <typename T>
+	[[nodiscard]] T p_min(const T* ptr, uint32_t length);
+	template <typename T>
+	[[nodiscard]] T p_max(const T* ptr, uint32_t length);
+	template <typename T>
+	[[nodiscard]] T p_sum(const T* ptr, uint32_t length);
+
+	template <typename T>
+	inline void p_fill(T* ptr, const uint32_t length, const T& value, std::false_type)
+	{
+		for (uint32_t i = 0; i < length; i++)
+			ptr[i] = value;
+	}
+	template <typename T>
+	inline void p_fill(T* ptr, const uint32_t length, const T& value, std::true_type)
+	{
+		using B = typename p_SimdBits<sizeof(T)>::Type;
+		B bits;
+		memcpy(&bits, &value, sizeof(T));
+		simdFill(reinterpret_cast<B*>(ptr), length, bits);
+	}
+	template <typename T>
+	inline int64_t p_find(const T* ptr, const uint32_t length, const T& value, std::false_type)
+	{
+		for (uint32_t i = 0; i < length; i++)
+			if (ptr[i] == value)
+				return i;
+		return -1;
+	}
+	template <typename T>
+	inline int64_t p_find(const T* ptr, const uint32_t length, const T& value, std::true_type)
+	{
+		using B = typename p_SimdBits<sizeof(T)>::Type;
+		B bits;
+		memcpy(&bits, &value, sizeof(T));
+		return simdFind(reinterpret_cast<const B*>(ptr), length, bits);
+	}
+	inline int64_t p_find(const float* ptr, const uint32_t length, const float& value, std::true_type)
+	{
+		return simdFind(ptr, length, value);
+	}
+	inline int64_t p_find(const double* ptr, const uint32_t length, const double& value, std::true_type)
+	{
+		return simdFind(ptr, length, value);
+	}
+	template <typename T>
+	inline uint64_t p_count(const T* ptr, const uint32_t length, const T& value, std::false_type)
+	{
+		uint64_t count = 0;
+		for (uint32_t i = 0; i < length; i++)
+			count += ptr[i] == value;
+		return count;
+	}
+	template <typename T>
+	inline uint64_t p_count(const T* ptr, const uint32_t length, const T& value, std::true_type)
+	{
+		using B = typename p_SimdBits<sizeof(T)>::Type;
+		B bits;
+		memcpy(&bits, &value, sizeof(T));
+		return simdCount(reinterpret_cast<const B*>(ptr), length, bits);
+	}
+	inline uint64_t p_count(const float* ptr, const uint32_t length, const float& value, std::true_type)
+	{
+		return simdCount(ptr, length, value);
+	}
+	inline uint64_t p_count(const double* ptr, const uint32_t length, const double& value, std::true_type)
+	{
+		return simdCount(ptr, length, value);
+	}
+	template <typename T>
+	inline uint32_t p_compress(T* dst, const T* src, const uint8_t* keep, const uint32_t length, const uint32_t capacity, std::false_type)
+	{
+		uint32_t n = 0;
+		for (uint32_t i = 0; i < length; i++)
+			if (keep[i])
+				dst[n++] = src[i];
+		return n;
+	}
+	template <typename T>
+	inline uint32_t p_compress(T* dst, const T* src, const uint8_t* keep, const uint32_t length, const uint32_t capacity, std::true_type)
+	{
+		return p_compressPod(dst, src, keep, length, capacity, std::integral_constant<bool, sizeof(T) == 4 || sizeof(T) == 8>());
+	}
+	template <typename T>
+	inline uint32_t p_compressPod(T* dst, const T* src, const uint8_t* keep, const uint32_t length, const uint32_t capacity, std::false_type)
+	{
+		// Always writes and only advances on a match, so unpredictable masks do not cost branch misses.
+		uint32_t n = 0;
+		for (uint32_t i = 0; i < length && n < capacity; i++)
+		{
+			dst[n] = src[i];
+			n += keep[i] != 0;
+		}
+		return n;
+	}
+	template <typename T>
+	inline uint32_t p_compressPod(T* dst, const T* src, const uint8_t* keep, const uint32_t length, const uint32_t capacity, std::true_type)
+	{
+		using B = typename p_SimdBits<sizeof(T)>::Type;
+		return static_cast<uint32_t>(simdCompress(reinterpret_cast<B*>(dst), reinterpret_cast<const B*>(src), keep, length, capacity));
+	}
+	template <typename T>
+	inline T p_min(const T* ptr, const uint32_t length)
+	{
+		T result = ptr[0];
+		for (uint32_t i = 1; i < length; i++)
+			if (ptr[i] < result)
+				result = ptr[i];
+		return result;
+	}
+	inline int32_t p_min(const int32_t* ptr, const uint32_t length)
+	{
+		return simdMin(ptr, length);
+	}
+	inline uint32_t p_min(const uint32_t* ptr, const uint32_t length)
+	{
+		return simdMin(ptr, length);
+	}
+	inline float p_min(const float* ptr, const uint32_t length)
+	{
+		return simdMin(ptr, length);
+	}
+	inline double p_min(const double* ptr, const uint32_t length)
+	{
+		return simdMin(ptr, length);
+	}
+	template <typename T>
+	inline T p_max(const T* ptr, const uint32_t length)
+	{
+		T result = ptr[0];
+		for (uint32_t i = 1; i < length; i++)
+			if (result < ptr[i])
+				result = ptr[i];
+		return result;
+	}
+	inline int32_t p_max(const int32_t* ptr, const uint32_t length)
+	{
+		return simdMax(ptr, length);
+	}
+	inline uint32_t p_max(const uint32_t* ptr, const uint32_t length)
+	{
+		return simdMax(ptr, length);
+	}
+	inline float p_max(const float* ptr, const uint32_t length)
+	{
+		return simdMax(ptr, length);
+	}
+	inline double p_max(const double* ptr, const uint32_t length)
+	{
+		return simdMax(ptr, length);
+	}
+	template <typename T>
+	inline T p_sum(const T* ptr, const uint32_t length)
+	{
+		T result{};
+		for (uint32_t i = 0; i < length; i++)
+			result = result + ptr[i];
+		return result;
+	}
+	inline int32_t p_sum(const int32_t* ptr, const uint32_t length)
+	{
+		return simdSum(ptr, length);
+	}
+	inline uint32_t p_sum(const uint32_t* ptr, const uint32_t length)
+	{
+		return simdSum(ptr, length);
+	}
+	inline float p_sum(const float* ptr, const uint32_t length)
+	{
+		return simdSum(ptr, length);
+	}
+	inline double p_sum(const double* ptr, const uint32_t length)
+	{
+		return simdSum(ptr, length);
+	}
+}
@@ -0,0 +1,181 @@
+#pragma once
+#include "Vec.h"
+#include <utility>
+
+namespace mem
+{
+	struct Handle final
+	{
+		uint32_t index = -1;
+		uint32_t generation = 0;
+
+		bool operator==(const Handle& other) const;
+		bool operator!=(const Handle& other) const;
+	};
+
+	inline bool Handle::operator==(const Handle& other) const
+	{
+		return index == other.index && generation == other.generation;
+	}
+	inline bool Handle::operator!=(const Handle& other) const
+	{
+		return !(*this == other);
+	}
+
+	// Values are packed at the front of one array, so iterating them is as fast as iterating an Arr.
+	// Handles point to a slot, which points to the value and remembers how often it has been reused.
+	// A removed value's handle has an old generation, so it is rejected instead of reaching whatever took its place.
+	// Removing moves the last value into the gap, so the order of values is not kept.
+	// Grows like Vec, which means it can not grow from a deeper scope than the one it was made in.
+	template <typename T>
+	struct SlotMap final
+	{
+		SlotMap();
+		SlotMap(uint8_t arena, uint32_t capacity);
+
+		Handle add();
+		Handle add(const T& value);
+		// Returns false when the handle is stale.
+		bool remove(Handle handle);
+		void clear();
+
+		// Returns null when the handle is stale.
+		[[nodiscard]] T* get(Handle handle) const;
+		[[nodiscard]] bool contains(Handle handle) const;
+		T& operator[](Handle handle) const;
+		uint32_t count() const;
+		// The values in storage order, which changes when values are removed.
+		Arr<T> arr() const;
+		Handle handleOf(uint32_t i) const;
+
+		template <typename U>
+		void iter(U func) const;
+
+	private:
+		struct Slot final
+		{
+			// Index in the values while in use, next free slot otherwise.
+			uint32_t value;
+			// Starts at 1 so a default handle never matches.
+			uint32_t generation;
+		};
+
+		Vec<T> _values{};
+		Vec<uint32_t> _valueSlots{};
+		Vec<Slot> _slots{};
+		uint32_t _freeSlot = -1;
+	};
+
+	template<typename T>
+	inline SlotMap<T>::SlotMap()
+	{
+	}
+	template<typename T>
+	inline SlotMap<T>::SlotMap(uint8_t arena, uint32_t capacity) :
+		_values(arena, capacity), _valueSlots(arena, capacity, uninit), _slots(arena, capacity, uninit)
+	{
+	}
+	template<typename T>
+	inline Handle SlotMap<T>::add()
+	{
+		uint32_t index = _freeSlot;
+		if (index != -1)
+			_freeSlot = _slots[index].value;
+		else
+		{
+			index = _slots.count();
+			_slots.add().generation = 1;
+		}
+
+		auto& slot = _slots[index];
+		slot.value = _values.count();
+		_values.add();
+		_valueSlots.add() = index;
+
+		Handle handle{};
+		handle.index = index;
+		handle.generation = slot.generation;
+		return handle;
+	}
+	template<typename T>
+	inline Handle SlotMap<T>::add(const T& value)
+	{
+		const Handle handle = add();
+		_values[_values.count() - 1] = value;
+		return handle;
+	}
+	template<typename T>
+	inline bool SlotMap<T>::remove(Handle handle)
+	{
+		if (!contains(handle))
+			return false;
+
+		auto& slot = _slots[handle.index];
+		const uint32_t last = _values.count() - 1;
+		if (slot.value != last)
+		{
+			_values[slot.value] = std::move(_values[last]);
+			const uint32_t moved = _valueSlots[slot.value] = _valueSlots[last];
+			_slots[moved].value = slot.value;
+		}
+		_values.setCount(last);
+		_valueSlots.setCount(last);
+
+		// Skips 0 when it wraps around, so default handles stay invalid.
+		if (++slot.generation == 0)
+			slot.generation = 1;
+		slot.value = _freeSlot;
+		_freeSlot = handle.index;
+		return true;
+	}
+	template<typename T>
+	inline void SlotMap<T>::clear()
+	{
+		while (_values.count() > 0)
+			remove(handleOf(_values.count() - 1));
+	}
+	template<typename T>
+	inline T* SlotMap<T>::get(Handle handle) const
+	{
+		if (!contains(handle))
+			return nullptr;
+		return &_values[_slots[handle.index].value];
+	}
+	template<typename T>
+	inline bool SlotMap<T>::contains(Handle handle) const
+	{
+		return handle.index < _slots.count() && _slots[handle.index].generation == handle.generation;
+	}
+	template<typename T>
+	inline T& SlotMap<T>::operator[](Handle handle) const
+	{
+		assert(contains(handle));
+		return _values[_slots[handle.index].value];
+	}
+	template<typename T>
+	inline uint32_t SlotMap<T>::count() const
+	{
+		return _values.count();
+	}
+	template<typename T>
+	inline Arr<T> SlotMap<T>::arr() const
+	{
+		return Arr<T>(_values.ptr(), _values.count());
+	}
+	template<typename T>
+	inline Handle SlotMap<T>::handleOf(uint32_t i) const
+	{
+		assert(i < _values.count());
+		Handle handle{};
+		handle.index = _valueSlots[i];
+		handle.generation = _slots[handle.index].generation;
+		return handle;
+	}
+	template<typename T>
+	template<typename U>
+	inline void SlotMap<T>::iter(U func) const
+	{
+		for (uint32_t i = 0; i < _values.count(); i++)
+			func(_values[i], handleOf(i));
+	}
+}
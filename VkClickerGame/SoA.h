@@ -0,0 +1,187 @@
+#pragma once
+#include "Arr.h"
+#include <tuple>
+#include <utility>
+
+namespace mem
+{
+	template <typename... Ts>
+	struct p_AllTriviallyCopyable;
+	template <>
+	struct p_AllTriviallyCopyable<> final : std::true_type {};
+	template <typename T, typename... Ts>
+	struct p_AllTriviallyCopyable<T, Ts...> final : std::integral_constant<bool,
+		std::is_trivially_copyable<T>::value && p_AllTriviallyCopyable<Ts...>::value> {};
+
+	// Structure of arrays. Every field gets its own column, so loops that only touch some fields only load those.
+	// The columns share one arena allocation and are aligned to 64 bytes. Grows like Vec, and removes by swapping
+	// the last element into the gap, so the order of elements is not kept. The old allocation is freed on TLSF arenas,
+	// and linear arenas only get it back when their scope is cleared.
+	template <typename... Ts>
+	struct SoA final
+	{
+		static_assert(sizeof...(Ts) > 0, "SoA needs at least one column.");
+		static_assert(p_AllTriviallyCopyable<Ts...>::value, "SoA moves its columns with plain copies.");
+
+		template <uint32_t I>
+		using Column = typename std::tuple_element<I, std::tuple<Ts...>>::type;
+
+		SoA();
+		SoA(ARENA arena, uint32_t capacity);
+		uint32_t count() const;
+		uint32_t capacity() const;
+
+		// The live elements of column I.
+		template <uint32_t I>
+		Arr<Column<I>> column() const;
+		template <uint32_t I>
+		Column<I>& get(uint32_t i) const;
+
+		// Adds a zeroed element and returns its index.
+		uint32_t add();
+		uint32_t add(const Ts&... values);
+		void remove(uint32_t i);
+		// Elements past the old count are zeroed.
+		void resize(uint32_t count);
+		void reserve(uint32_t capacity);
+		void clear();
+
+	private:
+		static constexpr uint32_t COLUMN_ALIGNMENT = 64;
+
+		void* _columns[sizeof...(Ts)]{};
+		uint32_t _count = 0;
+		uint32_t _capacity = 0;
+		ARENA _arena = NONE;
+		uint32_t _scopeDepth = 0;
+
+		void _zero(uint32_t from, uint32_t to);
+		template <size_t... Is>
+		void _set(std::index_sequence<Is...>, uint32_t i, const Ts&... values);
+	};
+	template<typename... Ts>
+	constexpr uint32_t SoA<Ts...>::COLUMN_ALIGNMENT;
+
+	template<typename... Ts>
+	inline SoA<Ts...>::SoA()
+	{
+	}
+	template<typename... Ts>
+	inline SoA<Ts...>::SoA(ARENA arena, uint32_t capacity) : _arena(arena), _scopeDepth(scopeDepth(arena))
+	{
+		reserve(capacity);
+	}
+	template<typename... Ts>
+	inline uint32_t SoA<Ts...>::count() const
+	{
+		return _count;
+	}
+	template<typename... Ts>
+	inline uint32_t SoA<Ts...>::capacity() const
+	{
+		return _capacity;
+	}
+	template<typename... Ts>
+	template<uint32_t I>
+	inline Arr<typename SoA<Ts...>::template Column<I>> SoA<Ts...>::column() const
+	{
+		return Arr<Column<I>>(static_cast<Column<I>*>(_columns[I]), _count);
+	}
+	template<typename... Ts>
+	template<uint32_t I>
+	inline typename SoA<Ts...>::template Column<I>& SoA<Ts...>::get(uint32_t i) const
+	{
+		assert(i < _count);
+		return static_cast<Column<I>*>(_columns[I])[i];
+	}
+	template<typename... Ts>
+	inline uint32_t SoA<Ts...>::add()
+	{
+		if (_count == _capacity)
+			reserve(_capacity < 4 ? 8 : _capacity * 2);
+		_zero(_count, _count + 1);
+		return _count++;
+	}
+	template<typename... Ts>
+	inline uint32_t SoA<Ts...>::add(const Ts&... values)
+	{
+		if (_count == _capacity)
+			reserve(_capacity < 4 ? 8 : _capacity * 2);
+		_set(std::index_sequence_for<Ts...>(), _count, values...);
+		return _count++;
+	}
+	template<typename... Ts>
+	inline void SoA<Ts...>::remove(uint32_t i)
+	{
+		assert(i < _count);
+		const uint32_t last = --_count;
+		if (i == last)
+			return;
+
+		const uint32_t sizes[] = { sizeof(Ts)... };
+		for (uint32_t c = 0; c < sizeof...(Ts); c++)
+		{
+			auto column = static_cast<uint8_t*>(_columns[c]);
+			memcpy(&column[sizes[c] * i], &column[sizes[c] * last], sizes[c]);
+		}
+	}
+	template<typename... Ts>
+	inline void SoA<Ts...>::resize(uint32_t count)
+	{
+		reserve(count);
+		if (count > _count)
+			_zero(_count, count);
+		_count = count;
+	}
+	template<typename... Ts>
+	inline void SoA<Ts...>::reserve(uint32_t capacity)
+	{
+		if (capacity <= _capacity)
+			return;
+		assert(_arena != NONE);
+		// The new columns would be cleared along with a scope made after this container.
+		assert(scopeDepth(_arena) == _scopeDepth);
+
+		const uint32_t sizes[] = { sizeof(Ts)... };
+		size_t offsets[sizeof...(Ts)];
+		size_t size = 0;
+		for (uint32_t c = 0; c < sizeof...(Ts); c++)
+		{
+			offsets[c] = size;
+			size += (sizes[c] * static_cast<size_t>(capacity) + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
+		}
+
+		// The first column starts the old allocation.
+		void* old = _columns[0];
+		auto ptr = static_cast<uint8_t*>(manualAlloc(_arena, size, COLUMN_ALIGNMENT));
+		for (uint32_t c = 0; c < sizeof...(Ts); c++)
+		{
+			if (_count > 0)
+				memcpy(&ptr[offsets[c]], _columns[c], sizes[c] * _count);
+			_columns[c] = &ptr[offsets[c]];
+		}
+		_capacity = capacity;
+		if (old)
+			manualRelease(_arena, old);
+	}
+	template<typename... Ts>
+	inline void SoA<Ts...>::clear()
+	{
+		_count = 0;
+	}
+	template<typename... Ts>
+	inline void SoA<Ts...>::_zero(uint32_t from, uint32_t to)
+	{
+		const uint32_t sizes[] = { sizeof(Ts)... };
+		for (uint32_t c = 0; c < sizeof...(Ts); c++)
+			memset(&static_cast<uint8_t*>(_columns[c])[sizes[c] * from], 0, sizes[c] * (to - from));
+	}
+	template<typename... Ts>
+	template<size_t... Is>
+	inline void SoA<Ts...>::_set(std::index_sequence<Is...>, uint32_t i, const Ts&... values)
+	{
+		// Expands to one assignment per column.
+		using Expand = int[];
+		(void)Expand{ 0, (static_cast<Ts*>(_columns[Is])[i] = values, 0)... };
+	}
+}
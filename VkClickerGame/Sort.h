@@ -0,0 +1,623 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+#include "mem.h"
+#include "ThreadPool.h"
+
+namespace mem
+{
+	// Pattern-defeating quicksort, used by Arr::sort and Arr::extSort.
+	// Quicksort with a median of three (or ninther) pivot that falls back to heapsort when partitions keep coming out
+	// unbalanced, so it stays O(n log n). Sorted, reversed and few unique inputs are recognized and finish in linear time.
+	// Runs in place and is not stable.
+	template <typename T, typename U>
+	void p_sort(T* ptr, uint32_t length, U less);
+
+	// Stable LSD radix sort on 8 bit digits, used by Arr::radixSort and Arr::radixExtSort.
+	// Sorts values by keys, moving both. Passes where every key has the same digit are skipped.
+	// Uses the scratch arena for the ping-pong buffers.
+	template <typename K, typename V>
+	void p_radixSort(K* keys, V* values, uint32_t length, ARENA scratch);
+
+	// Sorts chunks of the array on the thread pool, then merges them in parallel. The calling thread helps out and blocks
+	// until the sort is done. Falls back to p_sort when the array is smaller than the threshold or the pool is not running.
+	template <typename T, typename U>
+	void p_parallelSort(T* ptr, uint32_t length, U less, uint32_t threshold);
+
+	// Fixed width integer with the given size in bytes and signedness.
+	template <size_t S, bool Signed>
+	struct p_FixedInt;
+	template <> struct p_FixedInt<1, true> final { using type = int8_t; };
+	template <> struct p_FixedInt<1, false> final { using type = uint8_t; };
+	template <> struct p_FixedInt<2, true> final { using type = int16_t; };
+	template <> struct p_FixedInt<2, false> final { using type = uint16_t; };
+	template <> struct p_FixedInt<4, true> final { using type = int32_t; };
+	template <> struct p_FixedInt<4, false> final { using type = uint32_t; };
+	template <> struct p_FixedInt<8, true> final { using type = int64_t; };
+	template <> struct p_FixedInt<8, false> final { using type = uint64_t; };
+
+	// Enums sort by their underlying type.
+	template <typename K, bool = std::is_enum<K>::value>
+	struct p_RadixInt final
+	{
+		using type = typename p_FixedInt<sizeof(K), std::is_signed<K>::value>::type;
+	};
+	template <typename K>
+	struct p_RadixInt<K, true> final
+	{
+		using type = typename p_RadixInt<typename std::underlying_type<K>::type>::type;
+	};
+
+	// Maps keys to unsigned integers that sort in the same order. Signed integers have their sign bit flipped.
+	// 8 and 16 bit keys stay that small, so they take one and two passes.
+	[[nodiscard]] inline uint8_t p_radixKey(const uint8_t key)
+	{
+		return key;
+	}
+	[[nodiscard]] inline uint8_t p_radixKey(const int8_t key)
+	{
+		return static_cast<uint8_t>(static_cast<uint8_t>(key) ^ 0x80u);
+	}
+	[[nodiscard]] inline uint16_t p_radixKey(const uint16_t key)
+	{
+		return key;
+	}
+	[[nodiscard]] inline uint16_t p_radixKey(const int16_t key)
+	{
+		return static_cast<uint16_t>(static_cast<uint16_t>(key) ^ 0x8000u);
+	}
+	[[nodiscard]] inline uint32_t p_radixKey(const uint32_t key)
+	{
+		return key;
+	}
+	[[nodiscard]] inline uint32_t p_radixKey(const int32_t key)
+	{
+		return static_cast<uint32_t>(key) ^ 0x80000000u;
+	}
+	[[nodiscard]] inline uint64_t p_radixKey(const uint64_t key)
+	{
+		return key;
+	}
+	[[nodiscard]] inline uint64_t p_radixKey(const int64_t key)
+	{
+		return static_cast<uint64_t>(key) ^ 0x8000000000000000ull;
+	}
+	// Negative floats have all their bits flipped, positive floats only their sign bit.
+	[[nodiscard]] inline uint32_t p_radixKey(const float key)
+	{
+		uint32_t bits;
+		memcpy(&bits, &key, sizeof bits);
+		return bits ^ (bits >> 31 ? 0xFFFFFFFFu : 0x80000000u);
+	}
+	[[nodiscard]] inline uint64_t p_radixKey(const double key)
+	{
+		uint64_t bits;
+		memcpy(&bits, &key, sizeof bits);
+		return bits ^ (bits >> 63 ? 0xFFFFFFFFFFFFFFFFull : 0x8000000000000000ull);
+	}
+	// Catches the integer types that are not one of the fixed width ones above, like char, bool and long, as well as enums.
+	// Those are mapped to the fixed width integer of the same size and signedness.
+	template <typename K>
+	[[nodiscard]] inline auto p_radixKey(const K key)
+	{
+		static_assert(std::is_integral<K>::value || std::is_enum<K>::value,
+			"Radix sort keys have to be integers, enums, floats or doubles. Have the key function return one of those.");
+		return p_radixKey(static_cast<typename p_RadixInt<K>::type>(key));
+	}
+
+	constexpr uint32_t SORT_INSERTION_THRESHOLD = 24;
+	constexpr uint32_t SORT_NINTHER_THRESHOLD = 128;
+	constexpr uint32_t SORT_PARTIAL_INSERTION_LIMIT = 8;
+
+	template <typename T, typename U>
+	void p_insertionSort(T* begin, T* end, U& less)
+	{
+		if (begin == end)
+			return;
+		for (T* cur = begin + 1; cur != end; ++cur)
+		{
+			T* sift = cur;
+			T* siftPrev = cur - 1;
+			if (!less(*sift, *siftPrev))
+				continue;
+
+			T tmp = std::move(*sift);
+			do
+			{
+				*sift-- = std::move(*siftPrev);
+			} while (sift != begin && less(tmp, *--siftPrev));
+			*sift = std::move(tmp);
+		}
+	}
+
+	// Assumes there is an element in front of begin that is not greater than any element in the range.
+	template <typename T, typename U>
+	void p_unguardedInsertionSort(T* begin, T* end, U& less)
+	{
+		if (begin == end)
+			return;
+		for (T* cur = begin + 1; cur != end; ++cur)
+		{
+			T* sift = cur;
+			T* siftPrev = cur - 1;
+			if (!less(*sift, *siftPrev))
+				continue;
+
+			T tmp = std::move(*sift);
+			do
+			{
+				*sift-- = std::move(*siftPrev);
+			} while (less(tmp, *--siftPrev));
+			*sift = std::move(tmp);
+		}
+	}
+
+	// Gives up and returns false after moving more than a handful of elements.
+	template <typename T, typename U>
+	bool p_partialInsertionSort(T* begin, T* end, U& less)
+	{
+		if (begin == end)
+			return true;
+
+		uint32_t moved = 0;
+		for (T* cur = begin + 1; cur != end; ++cur)
+		{
+			T* sift = cur;
+			T* siftPrev = cur - 1;
+			if (!less(*sift, *siftPrev))
+				continue;
+
+			T tmp = std::move(*sift);
+			do
+			{
+				*sift-- = std::move(*siftPrev);
+			} while (sift != begin && less(tmp, *--siftPrev));
+			*sift = std::move(tmp);
+
+			moved += static_cast<uint32_t>(cur - sift);
+			if (moved > SORT_PARTIAL_INSERTION_LIMIT)
+				return false;
+		}
+		return true;
+	}
+
+	template <typename T, typename U>
+	void p_sort2(T* a, T* b, U& less)
+	{
+		if (less(*b, *a))
+			std::swap(*a, *b);
+	}
+
+	template <typename T, typename U>
+	void p_sort3(T* a, T* b, T* c, U& less)
+	{
+		p_sort2(a, b, less);
+		p_sort2(b, c, less);
+		p_sort2(a, b, less);
+	}
+
+	template <typename T, typename U>
+	void p_siftDown(T* heap, uint32_t length, uint32_t i, U& less)
+	{
+		while (true)
+		{
+			uint32_t child = i * 2 + 1;
+			if (child >= length)
+				return;
+			if (child + 1 < length && less(heap[child], heap[child + 1]))
+				++child;
+			if (!less(heap[i], heap[child]))
+				return;
+			std::swap(heap[i], heap[child]);
+			i = child;
+		}
+	}
+
+	template <typename T, typename U>
+	void p_heapSort(T* begin, T* end, U& less)
+	{
+		const uint32_t length = static_cast<uint32_t>(end - begin);
+		for (uint32_t i = length / 2; i-- > 0;)
+			p_siftDown(begin, length, i, less);
+		for (uint32_t i = length; i-- > 1;)
+		{
+			std::swap(begin[0], begin[i]);
+			p_siftDown(begin, i, 0, less);
+		}
+	}
+
+	// Partitions around the pivot at begin. Elements equal to the pivot go to the right.
+	// Sets alreadyPartitioned when no elements had to be swapped. Returns the final position of the pivot.
+	template <typename T, typename U>
+	T* p_partitionRight(T* begin, T* end, U& less, bool& alreadyPartitioned)
+	{
+		T pivot = std::move(*begin);
+		T* first = begin;
+		T* last = end;
+
+		// The median of three guarantees an element not less than the pivot exists, so the first search needs no bound.
+		while (less(*++first, pivot));
+		if (first - 1 == begin)
+			while (first < last && !less(*--last, pivot));
+		else
+			while (!less(*--last, pivot));
+
+		alreadyPartitioned = first >= last;
+		while (first < last)
+		{
+			std::swap(*first, *last);
+			while (less(*++first, pivot));
+			while (!less(*--last, pivot));
+		}
+
+		T* pivotPos = first - 1;
+		*begin = std::move(*pivotPos);
+		*pivotPos = std::move(pivot);
+		return pivotPos;
+	}
+
+	// Puts all elements equal to the pivot at begin on the left. Only used when the pivot equals the element in front
+	// of the range, in which case none of the elements can be less than it.
+	template <typename T, typename U>
+	T* p_partitionLeft(T* begin, T* end, U& less)
+	{
+		T pivot = std::move(*begin);
+		T* first = begin;
+		T* last = end;
+
+		while (less(pivot, *--last));
+		if (last + 1 == end)
+			while (first < last && !less(pivot, *++first));
+		else
+			while (!less(pivot, *++first));
+
+		while (first < last)
+		{
+			std::swap(*first, *last);
+			while (less(pivot, *--last));
+			while (!less(pivot, *++first));
+		}
+
+		T* pivotPos = last;
+		*begin = std::move(*pivotPos);
+		*pivotPos = std::move(pivot);
+		return pivotPos;
+	}
+
+	template <typename T, typename U>
+	void p_sortLoop(T* begin, T* end, U& less, uint32_t badAllowed, bool leftmost)
+	{
+		while (true)
+		{
+			const uint32_t size = static_cast<uint32_t>(end - begin);
+			if (size < SORT_INSERTION_THRESHOLD)
+			{
+				if (leftmost)
+					p_insertionSort(begin, end, less);
+				else
+					p_unguardedInsertionSort(begin, end, less);
+				return;
+			}
+
+			// Moves the pivot to the start of the range.
+			const uint32_t half = size / 2;
+			if (size > SORT_NINTHER_THRESHOLD)
+			{
+				p_sort3(begin, begin + half, end - 1, less);
+				p_sort3(begin + 1, begin + (half - 1), end - 2, less);
+				p_sort3(begin + 2, begin + (half + 1), end - 3, less);
+				p_sort3(begin + (half - 1), begin + half, begin + (half + 1), less);
+				std::swap(*begin, *(begin + half));
+			}
+			else
+				p_sort3(begin + half, begin, end - 1, less);
+
+			// If the element in front of the range is not less than the pivot, the pivot has many duplicates.
+			// Putting those on the left means they never have to be looked at again.
+			if (!leftmost && !less(*(begin - 1), *begin))
+			{
+				begin = p_partitionLeft(begin, end, less) + 1;
+				continue;
+			}
+
+			bool alreadyPartitioned;
+			T* pivotPos = p_partitionRight(begin, end, less, alreadyPartitioned);
+
+			const uint32_t leftSize = static_cast<uint32_t>(pivotPos - begin);
+			const uint32_t rightSize = static_cast<uint32_t>(end - (pivotPos + 1));
+			const bool highlyUnbalanced = leftSize < size / 8 || rightSize < size / 8;
+
+			if (highlyUnbalanced)
+			{
+				if (--badAllowed == 0)
+				{
+					p_heapSort(begin, end, less);
+					return;
+				}
+
+				// Breaks up patterns that made the pivot selection go wrong.
+				if (leftSize >= SORT_INSERTION_THRESHOLD)
+				{
+					std::swap(begin[0], begin[leftSize / 4]);
+					std::swap(pivotPos[-1], pivotPos[-static_cast<int64_t>(leftSize / 4)]);
+					if (leftSize > SORT_NINTHER_THRESHOLD)
+					{
+						std::swap(begin[1], begin[leftSize / 4 + 1]);
+						std::swap(begin[2], begin[leftSize / 4 + 2]);
+						std::swap(pivotPos[-2], pivotPos[-static_cast<int64_t>(leftSize / 4 + 1)]);
+						std::swap(pivotPos[-3], pivotPos[-static_cast<int64_t>(leftSize / 4 + 2)]);
+					}
+				}
+				if (rightSize >= SORT_INSERTION_THRESHOLD)
+				{
+					std::swap(pivotPos[1], pivotPos[1 + rightSize / 4]);
+					std::swap(end[-1], end[-static_cast<int64_t>(rightSize / 4)]);
+					if (rightSize > SORT_NINTHER_THRESHOLD)
+					{
+						std::swap(pivotPos[2], pivotPos[2 + rightSize / 4]);
+						std::swap(pivotPos[3], pivotPos[3 + rightSize / 4]);
+						std::swap(end[-2], end[-static_cast<int64_t>(1 + rightSize / 4)]);
+						std::swap(end[-3], end[-static_cast<int64_t>(2 + rightSize / 4)]);
+					}
+				}
+			}
+			// A partition that needed no swaps is likely sorted already.
+			else if (alreadyPartitioned && p_partialInsertionSort(begin, pivotPos, less)
+				&& p_partialInsertionSort(pivotPos + 1, end, less))
+				return;
+
+			// Recurses into the left side and loops on the right, so the stack depth stays O(log n).
+			p_sortLoop(begin, pivotPos, less, badAllowed, leftmost);
+			begin = pivotPos + 1;
+			leftmost = false;
+		}
+	}
+
+	template <typename T, typename U>
+	void p_sort(T* ptr, const uint32_t length, U less)
+	{
+		if (length < 2)
+			return;
+
+		uint32_t log = 0;
+		for (uint32_t i = length; i > 1; i >>= 1)
+			++log;
+		p_sortLoop(ptr, ptr + length, less, log, true);
+	}
+
+	template <typename K, typename V>
+	void p_radixSort(K* keys, V* values, const uint32_t length, const ARENA scratch)
+	{
+		constexpr uint32_t DIGITS = sizeof(K);
+		if (length < 2)
+			return;
+
+		auto _ = scope(scratch);
+		// All histograms are counted in a single pass over the keys.
+		auto counts = alloc<uint32_t>(scratch, DIGITS * 256);
+		for (uint32_t i = 0; i < length; i++)
+		{
+			const K key = keys[i];
+			for (uint32_t d = 0; d < DIGITS; d++)
+				++counts[d * 256 + ((key >> (d * 8)) & 0xFF)];
+		}
+
+		K* keysTemp = allocUninit<K>(scratch, length);
+		V* valuesTemp = allocUninit<V>(scratch, length);
+		K* srcKeys = keys;
+		V* srcValues = values;
+
+		for (uint32_t d = 0; d < DIGITS; d++)
+		{
+			const uint32_t* count = &counts[d * 256];
+			const uint32_t shift = d * 8;
+			if (count[(srcKeys[0] >> shift) & 0xFF] == length)
+				continue;
+
+			// Kept local so the compiler knows the scatter below can not overwrite it.
+			uint32_t offsets[256];
+			uint32_t offset = 0;
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				offsets[i] = offset;
+				offset += count[i];
+			}
+
+			K* dstKeys = srcKeys == keys ? keysTemp : keys;
+			V* dstValues = srcValues == values ? valuesTemp : values;
+			for (uint32_t i = 0; i < length; i++)
+			{
+				const K key = srcKeys[i];
+				const uint32_t index = offsets[(key >> shift) & 0xFF]++;
+				dstKeys[index] = key;
+				dstValues[index] = srcValues[i];
+			}
+			srcKeys = dstKeys;
+			srcValues = dstValues;
+		}
+
+		// After an odd amount of passes the result lives in the scratch buffers.
+		if (srcValues != values)
+			memcpy(values, srcValues, sizeof(V) * length);
+	}
+
+	// Shared between the tasks of a parallel sort. Every phase has a number of work items, which are claimed one at a time
+	// by the tasks and the calling thread alike, so it still finishes when the workers are busy with other tasks.
+	template <typename T, typename U>
+	struct ParallelSortJob final
+	{
+		T* src;
+		T* dst;
+		U* less;
+		uint32_t length;
+		// Length of the sorted runs that the current phase works on.
+		uint32_t width;
+		uint32_t segmentsPerPair;
+		uint32_t items;
+		std::atomic<uint32_t> next{ 0 };
+		std::atomic<uint32_t> done{ 0 };
+		// Tasks that have not finished yet. The job can not go out of scope before this hits zero.
+		std::atomic<uint32_t> active{ 0 };
+		bool merging;
+	};
+
+	// Amount of elements in front of output index k that come from a, when merging a and b with a winning ties.
+	template <typename T, typename U>
+	uint32_t p_mergeSplit(const T* a, uint32_t aLength, const T* b, uint32_t bLength, uint32_t k, U& less)
+	{
+		uint32_t lo = k > bLength ? k - bLength : 0;
+		uint32_t hi = k < aLength ? k : aLength;
+		while (lo < hi)
+		{
+			const uint32_t i = (lo + hi) / 2;
+			if (less(b[k - i - 1], a[i]))
+				hi = i;
+			else
+				lo = i + 1;
+		}
+		return lo;
+	}
+
+	template <typename T, typename U>
+	void p_parallelSortItem(ParallelSortJob<T, U>& job, const uint32_t item)
+	{
+		U& less = *job.less;
+		if (!job.merging)
+		{
+			const uint32_t start = item * job.width;
+			const uint32_t end = start + job.width < job.length ? start + job.width : job.length;
+			if (start < end)
+				p_sort(&job.src[start], end - start, less);
+			return;
+		}
+
+		// Every pair of runs is merged by several items, each writing an equal part of the output.
+		const uint32_t pair = item / job.segmentsPerPair;
+		const uint32_t segment = item % job.segmentsPerPair;
+		const uint32_t start = pair * job.width * 2;
+		const uint32_t mid = start + job.width < job.length ? start + job.width : job.length;
+		const uint32_t end = mid + job.width < job.length ? mid + job.width : job.length;
+		const T* a = &job.src[start];
+		const T* b = &job.src[mid];
+		const uint32_t aLength = mid - start;
+		const uint32_t bLength = end - mid;
+		const uint64_t total = aLength + bLength;
+
+		const uint32_t k0 = static_cast<uint32_t>(total * segment / job.segmentsPerPair);
+		const uint32_t k1 = static_cast<uint32_t>(total * (segment + 1) / job.segmentsPerPair);
+		uint32_t i = p_mergeSplit(a, aLength, b, bLength, k0, less);
+		uint32_t j = k0 - i;
+		const uint32_t iEnd = p_mergeSplit(a, aLength, b, bLength, k1, less);
+		const uint32_t jEnd = k1 - iEnd;
+
+		T* out = &job.dst[start + k0];
+		while (i < iEnd && j < jEnd)
+			*out++ = less(b[j], a[i]) ? b[j++] : a[i++];
+		while (i < iEnd)
+			*out++ = a[i++];
+		while (j < jEnd)
+			*out++ = b[j++];
+	}
+
+	template <typename T, typename U>
+	void p_parallelSortWork(ParallelSortJob<T, U>& job)
+	{
+		uint32_t item;
+		while ((item = job.next.fetch_add(1, std::memory_order_relaxed)) < job.items)
+		{
+			p_parallelSortItem(job, item);
+			job.done.fetch_add(1, std::memory_order_release);
+		}
+	}
+
+	template <typename T, typename U>
+	void p_parallelSortTask(void* userPtr, uint32_t, uint32_t)
+	{
+		auto& job = *static_cast<ParallelSortJob<T, U>*>(userPtr);
+		p_parallelSortWork(job);
+		job.active.fetch_sub(1, std::memory_order_release);
+	}
+
+	// Hands the items to the thread pool and works on them on the calling thread as well.
+	// Returns false without doing any work when the thread pool could not take a single task.
+	template <typename T, typename U>
+	bool p_parallelSortPhase(ParallelSortJob<T, U>& job, const uint32_t items, const uint32_t tasks)
+	{
+		job.items = items;
+		job.next.store(0, std::memory_order_relaxed);
+		job.done.store(0, std::memory_order_relaxed);
+		job.active.store(tasks, std::memory_order_release);
+
+		ThreadPoolTask task{};
+		task.func = p_parallelSortTask<T, U>;
+		task.userPtr = &job;
+		uint32_t added = 0;
+		while (added < tasks && tryAddThreadPoolTask(task))
+			++added;
+		if (added < tasks)
+			job.active.fetch_sub(tasks - added, std::memory_order_release);
+		if (added == 0)
+			return false;
+
+		p_parallelSortWork(job);
+		// Every item has been taken at this point. Tasks that no worker has picked up yet would only find nothing to do,
+		// so they are taken out of the queue instead of waited for. What is left is items that are still being worked on.
+		job.active.fetch_sub(cancelThreadPoolTasks(&job), std::memory_order_release);
+		while (job.done.load(std::memory_order_acquire) < items || job.active.load(std::memory_order_acquire) > 0)
+			std::this_thread::yield();
+		return true;
+	}
+
+	template <typename T, typename U>
+	void p_parallelSort(T* ptr, const uint32_t length, U less, const uint32_t threshold)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Parallel sort merges with plain copies.");
+		const uint32_t threads = threadPoolActive() ? getThreadCapacity() : 0;
+		if (length < threshold || threads == 0)
+		{
+			p_sort(ptr, length, less);
+			return;
+		}
+
+		// A power of two amount of chunks keeps the merge rounds even. The calling thread counts as one more thread.
+		uint32_t chunks = 1;
+		while (chunks * 2 <= threads + 1 && chunks * 2 <= length)
+			chunks *= 2;
+
+		auto _ = scope(TEMP);
+		ParallelSortJob<T, U> job{};
+		job.src = ptr;
+		job.dst = allocUninit<T>(TEMP, length);
+		job.less = &less;
+		job.length = length;
+		job.width = (length + chunks - 1) / chunks;
+		job.merging = false;
+		// A full queue means the workers are busy already, in which case splitting the work up would only add merges.
+		if (!p_parallelSortPhase(job, chunks, chunks - 1))
+		{
+			p_sort(ptr, length, less);
+			return;
+		}
+
+		job.merging = true;
+		while (job.width < length)
+		{
+			const uint32_t pairs = (length + job.width * 2 - 1) / (job.width * 2);
+			job.segmentsPerPair = chunks / pairs > 0 ? chunks / pairs : 1;
+			if (!p_parallelSortPhase(job, pairs * job.segmentsPerPair, chunks - 1))
+				p_parallelSortWork(job);
+
+			T* src = job.src;
+			job.src = job.dst;
+			job.dst = src;
+			job.width *= 2;
+		}
+
+		if (job.src != ptr)
+			memcpy(ptr, job.src, sizeof(T) * length);
+	}
+}
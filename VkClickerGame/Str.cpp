@@ -10,7 +10,10 @@ namespace mem
 	Str::Str(uint8_t arena, uint32_t length) : Arr<char>(arena, length)
 	{
 	}
-	Str::Str(uint8_t arena, const char* string) : Arr<char>(arena, strlen(string) + 1)
+	Str::Str(uint8_t arena, uint32_t length, Uninit) : Arr<char>(arena, length, uninit)
+	{
+	}
+	Str::Str(uint8_t arena, const char* string) : Arr<char>(arena, strlen(string) + 1, uninit)
 	{
 		set(string);
 	}
@@ -7,6 +7,7 @@ namespace mem
 	{
 		Str();
 		Str(uint8_t arena, uint32_t length);
+		Str(uint8_t arena, uint32_t length, Uninit);
 		Str(uint8_t arena, const char* string);
 
 		void set(const char* string);
@@ -25,7 +26,7 @@ namespace mem
 	template<typename ...Args>
 	inline Str Str::f(uint8_t arena, Args ...args)
 	{
-		Str str = Str(arena, _getLength(args...) + 1);
+		Str str = Str(arena, _getLength(args...) + 1, uninit);
 		str._put(0, args...);
 		str._ptr[str._length - 1] = '\0';
 		return str;
@@ -130,9 +130,10 @@ namespace gr {
 		SetFrameBuffers(arena, oldSwapChain);
 		SetFencesAndSemaphores();
 
-		auto res = _resources.arr(TEMP);
-		for (uint32_t i = 0; i < res.length(); i++)
-			res[i]->OnCreate(*_core, *this);
+		_resources.iter([this](SwapChainResource* resource, uint32_t)
+			{
+				resource->OnCreate(*_core, *this);
+			});
 
 		BeginFrame(window);
 	}
@@ -140,8 +141,9 @@ namespace gr {
 	{
 		auto _ = mem::scope(TEMP);
 
+		// Destroyed in the reverse order they were bound in.
 		auto res = _resources.arr(TEMP);
-		for (uint32_t i = 0; i < res.length(); i++)
+		for (int32_t i = res.length() - 1; i >= 0; i--)
 			res[i]->OnDestroy(*_core, *this);
 
 		vkDestroySemaphore(_core->device, _imageAvailableSemaphore, nullptr);
@@ -11,6 +11,11 @@ namespace mem
 	{
 		Queue<ThreadPoolTask> open;
 		Vec<ThreadPoolTask> closed;
+		// Tasks with a callback that have been added but not yet handled by threadPoolUpdate.
+		// Closed always has room for all of them, so workers never have to grow it.
+		uint32_t callbacks = 0;
+		// Tasks that a thread has picked up and not yet finished.
+		uint32_t running = 0;
 		Arr<std::thread> threads;
 		std::mutex mutex{};
 		std::condition_variable cv{};
@@ -20,6 +25,8 @@ namespace mem
 
 	void updateThread(const uint32_t id)
 	{
+		p_bindThread(id);
+
 		while (true)
 		{
 			ThreadPoolTask task;
@@ -33,11 +40,19 @@ namespace mem
 					break;
 
 				task = pool.open.pop();
+				++pool.running;
 			}
 			
 			task.func(task.userPtr, id, task.mId);
 
 			std::unique_lock<std::mutex> lock(pool.mutex);
+			--pool.running;
+			// Closed tasks are only kept around to run their callbacks on the main thread.
+			if (!task.callback)
+				continue;
+
+			// Room was made when the task was added, growing here would allocate from PERS on a worker thread.
+			assert(pool.closed.count() < pool.closed.length());
 			pool.closed.add() = task;
 		}
 	}
@@ -46,6 +61,10 @@ namespace mem
 	{
 		assert(!pool.init);
 		pool.init = true;
+		// Left set by a previous destroyThreadPool.
+		pool.quit = false;
+		pool.callbacks = 0;
+		pool.running = 0;
 
 		pool.open = { PERS, info.taskCapacity };
 		pool.closed = { PERS, info.taskCapacity };
@@ -74,18 +93,64 @@ namespace mem
 			if(task.callback)
 				task.callback(task.userPtr, task.mId);
 			});
+		pool.callbacks -= pool.closed.count();
 		pool.closed.clear();
 	}
 	void addThreadPoolTask(const ThreadPoolTask& task)
 	{
 		{
 			std::unique_lock<std::mutex> lock(pool.mutex);
+			// Makes room for the closed task up front, while still on the main thread.
+			if (task.callback)
+				pool.closed.reserve(++pool.callbacks);
 			pool.open.add() = task;
 		}
 		pool.cv.notify_one();
 	}
+	bool tryAddThreadPoolTask(const ThreadPoolTask& task)
+	{
+		{
+			std::unique_lock<std::mutex> lock(pool.mutex);
+			if (pool.open.count() == pool.open.length())
+				return false;
+			if (task.callback)
+				pool.closed.reserve(++pool.callbacks);
+			pool.open.add() = task;
+		}
+		pool.cv.notify_one();
+		return true;
+	}
+	uint32_t cancelThreadPoolTasks(const void* userPtr)
+	{
+		std::unique_lock<std::mutex> lock(pool.mutex);
+		// Cycles through the queue once, adding back the tasks that stay so their order is kept.
+		uint32_t removed = 0;
+		const uint32_t count = pool.open.count();
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const ThreadPoolTask task = pool.open.pop();
+			if (task.userPtr != userPtr)
+			{
+				pool.open.add() = task;
+				continue;
+			}
+			if (task.callback)
+				--pool.callbacks;
+			++removed;
+		}
+		return removed;
+	}
 	uint32_t getThreadCapacity()
 	{
 		return std::thread::hardware_concurrency();
 	}
+	bool threadPoolActive()
+	{
+		return pool.init;
+	}
+	bool threadPoolIdle()
+	{
+		std::unique_lock<std::mutex> lock(pool.mutex);
+		return pool.open.count() == 0 && pool.running == 0;
+	}
 }
\ No newline at end of file
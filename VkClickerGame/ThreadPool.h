@@ -18,8 +18,16 @@ namespace mem
 	void p_initThreadPool(const ThreadPoolInfo& info);
 	void destroyThreadPool();
 	void threadPoolUpdate();
+	// Tasks with a callback have to be added from the main thread, since room for them is made in PERS.
 	void addThreadPoolTask(const ThreadPoolTask& task);
+	// Same as addThreadPoolTask, but returns false instead of pushing out the oldest open task when the queue is full.
+	[[nodiscard]] bool tryAddThreadPoolTask(const ThreadPoolTask& task);
+	// Removes the open tasks with the given user pointer that no thread has picked up yet. Returns how many were removed.
+	uint32_t cancelThreadPoolTasks(const void* userPtr);
 	uint32_t getThreadCapacity();
+	bool threadPoolActive();
+	// Whether no task is waiting or being worked on. Callbacks of finished tasks can still be waiting for threadPoolUpdate.
+	[[nodiscard]] bool threadPoolIdle();
 }
 
 
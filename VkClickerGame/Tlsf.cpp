@@ -0,0 +1,403 @@
+#include "pch.h"
+#include "Tlsf.h"
+#include "Math.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace jv
+{
+	constexpr uint32_t SL_INDEX_COUNT_LOG2 = 5;
+	constexpr uint32_t SL_INDEX_COUNT = 1 << SL_INDEX_COUNT_LOG2;
+	constexpr uint32_t ALIGN_SIZE_LOG2 = 3;
+	constexpr uint64_t ALIGN_SIZE = 1 << ALIGN_SIZE_LOG2;
+	// Blocks below this size all go in the first level, split linearly over the second level.
+	constexpr uint32_t FL_INDEX_SHIFT = SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2;
+	constexpr uint32_t FL_INDEX_MAX = 48;
+	constexpr uint32_t FL_INDEX_COUNT = FL_INDEX_MAX - FL_INDEX_SHIFT + 1;
+	constexpr uint64_t SMALL_BLOCK_SIZE = 1ull << FL_INDEX_SHIFT;
+
+	constexpr uint64_t BLOCK_FREE_BIT = 1 << 0;
+	constexpr uint64_t BLOCK_PREV_FREE_BIT = 1 << 1;
+
+	// The previous physical block pointer is only valid when that block is free, in which case it is stored in its last bytes.
+	// The free list pointers only exist in free blocks, and overlap with the user data otherwise.
+	struct Block final
+	{
+		Block* prevPhys;
+		uint64_t size;
+		Block* nextFree;
+		Block* prevFree;
+	};
+
+	// Only the size field is in front of the user data.
+	constexpr uint64_t BLOCK_OVERHEAD = sizeof(uint64_t);
+	constexpr uint64_t BLOCK_START_OFFSET = sizeof(Block*) + sizeof(uint64_t);
+	constexpr uint64_t BLOCK_SIZE_MIN = sizeof(Block) - sizeof(Block*);
+	constexpr uint64_t BLOCK_SIZE_MAX = 1ull << FL_INDEX_MAX;
+
+	// Stored in front of every pool so they can be handed back on destroy.
+	struct Pool final
+	{
+		Pool* next;
+		uint64_t size;
+	};
+
+	// Pools need room for their header, one block and the zero sized sentinel block at the end.
+	constexpr uint64_t POOL_OVERHEAD = sizeof(Pool) + 2 * BLOCK_OVERHEAD;
+
+	struct Tlsf::Control final
+	{
+		uint64_t flBitmap = 0;
+		uint32_t slBitmap[FL_INDEX_COUNT]{};
+		Block* blocks[FL_INDEX_COUNT][SL_INDEX_COUNT]{};
+		Pool* pools = nullptr;
+	};
+
+	uint32_t Fls(const uint64_t value)
+	{
+		assert(value);
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return index;
+#else
+		return 63 - __builtin_clzll(value);
+#endif
+	}
+
+	uint32_t Ffs(const uint64_t value)
+	{
+		assert(value);
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return index;
+#else
+		return __builtin_ctzll(value);
+#endif
+	}
+
+	uint64_t BlockSize(const Block* block)
+	{
+		return block->size & ~(BLOCK_FREE_BIT | BLOCK_PREV_FREE_BIT);
+	}
+
+	void SetBlockSize(Block* block, const uint64_t size)
+	{
+		block->size = size | (block->size & (BLOCK_FREE_BIT | BLOCK_PREV_FREE_BIT));
+	}
+
+	void SetFlag(Block* block, const uint64_t flag, const bool value)
+	{
+		block->size = value ? block->size | flag : block->size & ~flag;
+	}
+
+	Block* BlockFromPtr(const void* ptr)
+	{
+		return reinterpret_cast<Block*>(const_cast<char*>(static_cast<const char*>(ptr)) - BLOCK_START_OFFSET);
+	}
+
+	void* BlockToPtr(const Block* block)
+	{
+		return const_cast<char*>(reinterpret_cast<const char*>(block)) + BLOCK_START_OFFSET;
+	}
+
+	Block* OffsetToBlock(const void* ptr, const int64_t offset)
+	{
+		return reinterpret_cast<Block*>(const_cast<char*>(static_cast<const char*>(ptr)) + offset);
+	}
+
+	Block* BlockNext(const Block* block)
+	{
+		assert(BlockSize(block) > 0);
+		return OffsetToBlock(BlockToPtr(block), static_cast<int64_t>(BlockSize(block) - BLOCK_OVERHEAD));
+	}
+
+	Block* LinkNext(Block* block)
+	{
+		Block* next = BlockNext(block);
+		next->prevPhys = block;
+		return next;
+	}
+
+	void MarkAsFree(Block* block)
+	{
+		SetFlag(LinkNext(block), BLOCK_PREV_FREE_BIT, true);
+		SetFlag(block, BLOCK_FREE_BIT, true);
+	}
+
+	void MarkAsUsed(Block* block)
+	{
+		SetFlag(BlockNext(block), BLOCK_PREV_FREE_BIT, false);
+		SetFlag(block, BLOCK_FREE_BIT, false);
+	}
+
+	uint64_t AlignUp(const uint64_t value, const uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	void MappingInsert(const uint64_t size, uint32_t& fl, uint32_t& sl)
+	{
+		if (size < SMALL_BLOCK_SIZE)
+		{
+			fl = 0;
+			sl = static_cast<uint32_t>(size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT));
+			return;
+		}
+		const uint32_t f = Fls(size);
+		sl = static_cast<uint32_t>(size >> (f - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+		fl = f - (FL_INDEX_SHIFT - 1);
+	}
+
+	// Rounds up to the next bin, so that any block found there is large enough.
+	void MappingSearch(uint64_t size, uint32_t& fl, uint32_t& sl)
+	{
+		if (size >= SMALL_BLOCK_SIZE)
+			size += (1ull << (Fls(size) - SL_INDEX_COUNT_LOG2)) - 1;
+		MappingInsert(size, fl, sl);
+	}
+
+	Block* SearchSuitableBlock(const Tlsf::Control& control, uint32_t& fl, uint32_t& sl)
+	{
+		uint32_t slMap = control.slBitmap[fl] & (~0u << sl);
+		if (!slMap)
+		{
+			const uint64_t flMap = fl + 1 < 64 ? control.flBitmap & (~0ull << (fl + 1)) : 0;
+			if (!flMap)
+				return nullptr;
+			fl = Ffs(flMap);
+			slMap = control.slBitmap[fl];
+		}
+		sl = Ffs(slMap);
+		return control.blocks[fl][sl];
+	}
+
+	void RemoveFreeBlock(Tlsf::Control& control, Block* block, const uint32_t fl, const uint32_t sl)
+	{
+		Block* prev = block->prevFree;
+		Block* next = block->nextFree;
+		if (next)
+			next->prevFree = prev;
+		if (prev)
+			prev->nextFree = next;
+
+		if (control.blocks[fl][sl] != block)
+			return;
+		control.blocks[fl][sl] = next;
+		if (next)
+			return;
+		control.slBitmap[fl] &= ~(1u << sl);
+		if (!control.slBitmap[fl])
+			control.flBitmap &= ~(1ull << fl);
+	}
+
+	void InsertFreeBlock(Tlsf::Control& control, Block* block, const uint32_t fl, const uint32_t sl)
+	{
+		Block* current = control.blocks[fl][sl];
+		block->nextFree = current;
+		block->prevFree = nullptr;
+		if (current)
+			current->prevFree = block;
+		control.blocks[fl][sl] = block;
+		control.flBitmap |= 1ull << fl;
+		control.slBitmap[fl] |= 1u << sl;
+	}
+
+	void RemoveBlock(Tlsf::Control& control, Block* block)
+	{
+		uint32_t fl, sl;
+		MappingInsert(BlockSize(block), fl, sl);
+		RemoveFreeBlock(control, block, fl, sl);
+	}
+
+	void InsertBlock(Tlsf::Control& control, Block* block)
+	{
+		uint32_t fl, sl;
+		MappingInsert(BlockSize(block), fl, sl);
+		InsertFreeBlock(control, block, fl, sl);
+	}
+
+	bool CanSplit(const Block* block, const uint64_t size)
+	{
+		return BlockSize(block) >= sizeof(Block) + size;
+	}
+
+	// Splits off everything past size as a new free block.
+	Block* Split(Block* block, const uint64_t size)
+	{
+		Block* remaining = OffsetToBlock(BlockToPtr(block), static_cast<int64_t>(size - BLOCK_OVERHEAD));
+		const uint64_t remainingSize = BlockSize(block) - (size + BLOCK_OVERHEAD);
+		remaining->size = 0;
+		SetBlockSize(remaining, remainingSize);
+		SetBlockSize(block, size);
+		MarkAsFree(remaining);
+		return remaining;
+	}
+
+	Block* Absorb(Block* prev, const Block* block)
+	{
+		prev->size += BlockSize(block) + BLOCK_OVERHEAD;
+		LinkNext(prev);
+		return prev;
+	}
+
+	Block* MergePrev(Tlsf::Control& control, Block* block)
+	{
+		if (!(block->size & BLOCK_PREV_FREE_BIT))
+			return block;
+		Block* prev = block->prevPhys;
+		RemoveBlock(control, prev);
+		return Absorb(prev, block);
+	}
+
+	Block* MergeNext(Tlsf::Control& control, Block* block)
+	{
+		Block* next = BlockNext(block);
+		if (!(next->size & BLOCK_FREE_BIT))
+			return block;
+		RemoveBlock(control, next);
+		return Absorb(block, next);
+	}
+
+	void TrimFree(Tlsf::Control& control, Block* block, const uint64_t size)
+	{
+		if (!CanSplit(block, size))
+			return;
+		Block* remaining = Split(block, size);
+		LinkNext(block);
+		SetFlag(remaining, BLOCK_PREV_FREE_BIT, true);
+		InsertBlock(control, remaining);
+	}
+
+	// Hands the first size bytes of a free block back to the allocator, and returns the rest.
+	Block* TrimFreeLeading(Tlsf::Control& control, Block* block, const uint64_t size)
+	{
+		if (!CanSplit(block, size))
+			return block;
+		Block* remaining = Split(block, size - BLOCK_OVERHEAD);
+		SetFlag(remaining, BLOCK_PREV_FREE_BIT, true);
+		LinkNext(block);
+		InsertBlock(control, block);
+		return remaining;
+	}
+
+	void AddPool(Tlsf::Control& control, void* memory, const uint64_t size)
+	{
+		const auto pool = static_cast<Pool*>(memory);
+		pool->next = control.pools;
+		pool->size = size;
+		control.pools = pool;
+
+		// The first block starts one field early, its prevPhys is never read since nothing comes before it.
+		const uint64_t blockSize = (size - POOL_OVERHEAD) & ~(ALIGN_SIZE - 1);
+		Block* block = OffsetToBlock(&pool[1], -static_cast<int64_t>(BLOCK_OVERHEAD));
+		block->size = 0;
+		SetBlockSize(block, blockSize);
+		SetFlag(block, BLOCK_FREE_BIT, true);
+		InsertBlock(control, block);
+
+		Block* sentinel = LinkNext(block);
+		sentinel->size = BLOCK_PREV_FREE_BIT;
+	}
+
+	Tlsf Tlsf::Create(const ArenaCreateInfo& info)
+	{
+		assert(info.alloc);
+		assert(info.free);
+		assert(!info.memory);
+		assert(info.memorySize > POOL_OVERHEAD + BLOCK_SIZE_MIN);
+
+		Tlsf tlsf{};
+		tlsf.info = info;
+		tlsf.control = new(info.alloc(sizeof(Control))) Control();
+		AddPool(*tlsf.control, info.alloc(info.memorySize), info.memorySize);
+		return tlsf;
+	}
+
+	void Tlsf::Destroy(const Tlsf& tlsf)
+	{
+		Pool* pool = tlsf.control->pools;
+		while (pool)
+		{
+			Pool* next = pool->next;
+			tlsf.info.free(pool);
+			pool = next;
+		}
+		tlsf.info.free(tlsf.control);
+	}
+
+	void* Tlsf::Alloc(const uint64_t size, const uint32_t alignment)
+	{
+		assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+		assert(size < BLOCK_SIZE_MAX);
+
+		const uint64_t adjusted = Max<uint64_t>(AlignUp(Max<uint64_t>(size, 1), ALIGN_SIZE), BLOCK_SIZE_MIN);
+		// Leaves room to align the pointer and hand the gap in front of it back as a free block.
+		const uint64_t gapMinimum = sizeof(Block);
+		const uint64_t searchSize = alignment > ALIGN_SIZE ? AlignUp(adjusted + alignment + gapMinimum, ALIGN_SIZE) : adjusted;
+
+		uint32_t fl, sl;
+		MappingSearch(searchSize, fl, sl);
+		Block* block = fl < FL_INDEX_COUNT ? SearchSuitableBlock(*control, fl, sl) : nullptr;
+		if (!block)
+		{
+			// Searches round up to the next second level bin, which the new block has to reach.
+			const uint64_t poolSize = Max<uint64_t>(info.memorySize, searchSize + searchSize / SL_INDEX_COUNT + POOL_OVERHEAD + SMALL_BLOCK_SIZE);
+			AddPool(*control, info.alloc(poolSize), poolSize);
+			MappingSearch(searchSize, fl, sl);
+			block = SearchSuitableBlock(*control, fl, sl);
+			assert(block);
+		}
+		RemoveFreeBlock(*control, block, fl, sl);
+
+		if (alignment > ALIGN_SIZE)
+		{
+			const auto ptr = reinterpret_cast<uintptr_t>(BlockToPtr(block));
+			uintptr_t aligned = AlignUp(ptr, alignment);
+			// A gap has to fit a whole block header before it can be handed back.
+			if (aligned != ptr && aligned - ptr < gapMinimum)
+				aligned = AlignUp(aligned + Max<uint64_t>(gapMinimum - (aligned - ptr), alignment), alignment);
+			if (aligned != ptr)
+				block = TrimFreeLeading(*control, block, aligned - ptr);
+		}
+
+		TrimFree(*control, block, adjusted);
+		MarkAsUsed(block);
+		return BlockToPtr(block);
+	}
+
+	void Tlsf::Free(void* ptr)
+	{
+		if (!ptr)
+			return;
+		Block* block = BlockFromPtr(ptr);
+		assert(!(block->size & BLOCK_FREE_BIT));
+		MarkAsFree(block);
+		block = MergePrev(*control, block);
+		block = MergeNext(*control, block);
+		InsertBlock(*control, block);
+	}
+
+	void Tlsf::Clear()
+	{
+		Pool* pool = control->pools;
+		*control = Control();
+		while (pool)
+		{
+			Pool* next = pool->next;
+			AddPool(*control, pool, pool->size);
+			pool = next;
+		}
+	}
+
+	uint64_t Tlsf::GetTotalUsedMemory() const
+	{
+		uint64_t size = 0;
+		for (const Pool* pool = control->pools; pool; pool = pool->next)
+			size += pool->size;
+		return size;
+	}
+}
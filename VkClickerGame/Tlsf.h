@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include "Arena.h"
+
+namespace jv
+{
+	// Two level segregated fit allocator, for memory with unrelated lifetimes.
+	// Allocations and frees run in constant time. Free blocks are binned per power of two (first level)
+	// and per 32 linear steps within that power (second level), which bounds the fragmentation.
+	// Grows by adding pools from info.alloc when it runs out of memory.
+	struct Tlsf final
+	{
+		struct Control;
+
+		ArenaCreateInfo info;
+		Control* control = nullptr;
+
+		__declspec(dllexport) [[nodiscard]] static Tlsf Create(const ArenaCreateInfo& info);
+		__declspec(dllexport) static void Destroy(const Tlsf& tlsf);
+
+		// Alignment has to be a power of two. Alignments up to 8 are free.
+		__declspec(dllexport) [[nodiscard]] void* Alloc(uint64_t size, uint32_t alignment = 8);
+		__declspec(dllexport) void Free(void* ptr);
+		// Frees everything, but keeps all pools.
+		__declspec(dllexport) void Clear();
+		__declspec(dllexport) [[nodiscard]] uint64_t GetTotalUsedMemory() const;
+	};
+}
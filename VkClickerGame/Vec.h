@@ -3,26 +3,48 @@
 
 namespace mem
 {
+	// Grows when it runs out of capacity. A buffer at the front of a linear arena is extended in place,
+	// otherwise it is moved to a buffer twice its size. The old buffer is freed on TLSF arenas, and stays in use on linear
+	// arenas until their scope is cleared.
+	// Growing from a deeper scope than the one the vector was made in is not supported, since that scope would take the
+	// grown memory with it when it is cleared.
+	// Add constructs a new element in the slot past the count without destroying what was there, so elements the vector
+	// was made with beyond its count should not own anything. Vectors made from an existing array can not grow.
 	template <typename T>
 	struct Vec : Arr<T>
 	{
 		Vec();
 		Vec(uint8_t arena, uint32_t length);
+		Vec(uint8_t arena, uint32_t length, Uninit);
 		Vec(Arr<T>& arr);
 		T& add();
 		void clear();
-		uint32_t count();
+		uint32_t count() const;
 		Arr<T> arr();
 		void setCount(uint32_t i);
+		// Makes sure there is room for at least length elements.
+		void reserve(uint32_t length);
+		// Same as Arr::removeIf over the first count elements, but it lowers the count instead of the capacity.
+		template <typename U>
+		uint32_t removeIf(U func);
 	private:
 		uint32_t _count = 0;
+		ARENA _arena = NONE;
+		uint32_t _scopeDepth = 0;
+
+		void _relocate(uint32_t length, std::true_type);
+		void _relocate(uint32_t length, std::false_type);
 	};
 	template<typename T>
 	inline Vec<T>::Vec()
 	{
 	}
 	template<typename T>
-	inline Vec<T>::Vec(uint8_t arena, uint32_t length) : Arr<T>(arena, length)
+	inline Vec<T>::Vec(uint8_t arena, uint32_t length) : Arr<T>(arena, length), _arena(arena), _scopeDepth(scopeDepth(arena))
+	{
+	}
+	template<typename T>
+	inline Vec<T>::Vec(uint8_t arena, uint32_t length, Uninit) : Arr<T>(arena, length, uninit), _arena(arena), _scopeDepth(scopeDepth(arena))
 	{
 	}
 	template<typename T>
@@ -35,8 +57,9 @@ namespace mem
 	template<typename T>
 	inline T& Vec<T>::add()
 	{
-		assert(_count < Arr<T>::_length);
-		return Arr<T>::_ptr[_count++];
+		if (_count == Arr<T>::_length)
+			reserve(Arr<T>::_length < 4 ? 8 : Arr<T>::_length * 2);
+		return *new(&Arr<T>::_ptr[_count++]) T();
 	}
 	template<typename T>
 	inline void Vec<T>::clear()
@@ -44,7 +67,7 @@ namespace mem
 		_count = 0;
 	}
 	template<typename T>
-	inline uint32_t Vec<T>::count()
+	inline uint32_t Vec<T>::count() const
 	{
 		return _count;
 	}
@@ -59,5 +82,57 @@ namespace mem
 		assert(i <= Arr<T>::_length);
 		_count = i;
 	}
+	template<typename T>
+	inline void Vec<T>::reserve(uint32_t length)
+	{
+		if (length <= Arr<T>::_length)
+			return;
+		// Vectors made from an existing array do not know where their memory came from.
+		if (_arena == NONE)
+			throw std::exception("Vector made from an array can not grow.");
+		assert(scopeDepth(_arena) == _scopeDepth);
+
+		if (Arr<T>::_ptr && manualExtend(_arena, Arr<T>::_ptr, sizeof(T) * length))
+		{
+			Arr<T>::_length = length;
+			return;
+		}
+		_relocate(length, std::is_trivially_copyable<T>());
+	}
+	template<typename T>
+	template<typename U>
+	inline uint32_t Vec<T>::removeIf(U func)
+	{
+		auto live = arr();
+		_count = live.removeIf(func);
+		return _count;
+	}
+	template<typename T>
+	inline void Vec<T>::_relocate(uint32_t length, std::true_type)
+	{
+		T* old = Arr<T>::_ptr;
+		T* ptr = allocUninit<T>(_arena, length);
+		if (_count > 0)
+			memcpy(ptr, old, sizeof(T) * _count);
+		Arr<T>::_ptr = ptr;
+		Arr<T>::_length = length;
+		if (old)
+			manualRelease(_arena, old);
+	}
+	template<typename T>
+	inline void Vec<T>::_relocate(uint32_t length, std::false_type)
+	{
+		T* old = Arr<T>::_ptr;
+		T* ptr = allocUninit<T>(_arena, length);
+		for (uint32_t i = 0; i < _count; i++)
+		{
+			new(&ptr[i]) T(std::move(old[i]));
+			old[i].~T();
+		}
+		Arr<T>::_ptr = ptr;
+		Arr<T>::_length = length;
+		if (old)
+			manualRelease(_arena, old);
+	}
 }
 
@@ -13,6 +13,7 @@
 #include "DescriptorWriter.h"
 #include "DescriptorPool.h"
 #include "Allocators.h"
+#include "MemSelfTest.h"
 
 struct Renderer final {
     void Init(const gr::Core& core, gr::SwapChain& swapChain, gr::DescriptorSetLayoutManager& descLayoutManager) {
@@ -170,6 +171,9 @@ private:
 
 int main()
 {
+#ifdef MEM_SELFTEST
+    return mem::selfTest() == 0 ? 0 : 1;
+#endif
     mem::Info info{};
     info.persistentLength = 2;
     mem::init(info);
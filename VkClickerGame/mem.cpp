@@ -1,22 +1,110 @@
 #include "pch.h"
 #include "mem.h"
 #include "Arena.h"
+#include "ConcurrentArena.h"
+#include "Tlsf.h"
+#include "ArenaBlockCache.h"
+#include "ThreadPool.h"
+#include <thread>
+#include <atomic>
 
 namespace mem
 {
+	// Scratch arenas for thread pool workers, created the first time a worker uses them.
+	struct ThreadArenas final {
+		jv::Arena arenas[2];
+		jv::Arena* pendingFrames = nullptr;
+		std::atomic<bool> created{ false };
+	};
+
 	jv::Arena* arenas = nullptr;
 	uint32_t arenasLength;
+	ArenaType* arenaTypes = nullptr;
+	// Only the slots of the matching type are valid.
+	jv::ConcurrentArena* concurrentArenas = nullptr;
+	jv::Tlsf* tlsfArenas = nullptr;
+	// Only allocated when stats are enabled.
+	jv::ArenaStats* arenaStats = nullptr;
+	ArenaReport* reports = nullptr;
+	ThreadArenas* threadArenas = nullptr;
+	uint32_t threadArenasLength;
+	jv::ArenaCreateInfo threadArenaInfos[2];
+	// FRAM arenas of earlier frames that are still in flight. The active one is always in the FRAM slot,
+	// and gets swapped with the oldest pending one every frame.
+	jv::Arena* pendingFrames = nullptr;
+	uint32_t pendingFramesLength;
+	uint32_t pendingFrameIndex = 0;
+	jv::ArenaBlockCache blockCache{};
+	thread_local ThreadArenas* boundThreadArenas = nullptr;
+
+	jv::Arena* createPendingFrames(const jv::ArenaCreateInfo& info)
+	{
+		if (pendingFramesLength == 0)
+			return nullptr;
+		auto frames = reinterpret_cast<jv::Arena*>(malloc(sizeof(jv::Arena) * pendingFramesLength));
+		for (uint32_t i = 0; i < pendingFramesLength; i++)
+			frames[i] = jv::Arena::Create(info);
+		return frames;
+	}
+
+	void destroyPendingFrames(jv::Arena* frames)
+	{
+		for (uint32_t i = 0; i < pendingFramesLength; i++)
+			jv::Arena::Destroy(frames[i]);
+		free(frames);
+	}
+
+	void nextFrame(jv::Arena& active, jv::Arena* frames)
+	{
+		// A scope still open here would later rewind whichever arena takes this one's place.
+		assert(active.openScopes == 0);
+		if (pendingFramesLength > 0)
+		{
+			const jv::Arena arena = active;
+			active = frames[pendingFrameIndex];
+			frames[pendingFrameIndex] = arena;
+		}
+		active.Clear();
+	}
+
+	jv::Arena& getArena(const ARENA arena)
+	{
+		if (arena > FRAM || !boundThreadArenas)
+			return arenas[arena];
+
+		if (!boundThreadArenas->created.load(std::memory_order_acquire))
+		{
+			boundThreadArenas->arenas[TEMP] = jv::Arena::Create(threadArenaInfos[TEMP]);
+			boundThreadArenas->arenas[FRAM] = jv::Arena::Create(threadArenaInfos[FRAM]);
+			boundThreadArenas->pendingFrames = createPendingFrames(threadArenaInfos[FRAM]);
+			boundThreadArenas->created.store(true, std::memory_order_release);
+		}
+		return boundThreadArenas->arenas[arena];
+	}
 
 	struct PScope final {
 		PScope() {}
 		PScope(Scope& scope, ARENA arena, bool manual) {
 			scope._arena = arena;
 			scope._manual = manual;
-			scope._scope = arenas[arena].CreateScope();
+			switch (arenaTypes[arena])
+			{
+			case ArenaType::linear:
+				scope._scope = getArena(arena).CreateScope();
+				break;
+			case ArenaType::concurrent:
+				// Concurrent arenas can only be cleared as a whole, so their scopes have to start out empty.
+				assert(concurrentArenas[arena].root->front == 0 && concurrentArenas[arena].tail->load() == concurrentArenas[arena].root);
+				scope._scope = 0;
+				break;
+			case ArenaType::tlsf:
+				scope._scope = 0;
+				break;
+			}
 		}
 	};
 
-	void* MAlloc(const uint32_t size)
+	void* MAlloc(const uint64_t size)
 	{
 		return malloc(size);
 	}
@@ -31,35 +119,182 @@ namespace mem
 		assert(!arenas);
 		uint32_t len = 2 + (info.persistentLength == 0 ? 1 : info.persistentLength);
 		arenas = reinterpret_cast<jv::Arena*>(malloc(sizeof(jv::Arena) * len));
+		arenaTypes = reinterpret_cast<ArenaType*>(malloc(sizeof(ArenaType) * len));
+		concurrentArenas = reinterpret_cast<jv::ConcurrentArena*>(malloc(sizeof(jv::ConcurrentArena) * len));
+		tlsfArenas = reinterpret_cast<jv::Tlsf*>(malloc(sizeof(jv::Tlsf) * len));
+		if (info.stats)
+		{
+			arenaStats = reinterpret_cast<jv::ArenaStats*>(malloc(sizeof(jv::ArenaStats) * len));
+			reports = reinterpret_cast<ArenaReport*>(malloc(sizeof(ArenaReport) * len));
+			for (uint32_t i = 0; i < len; i++)
+			{
+				new(&arenaStats[i]) jv::ArenaStats();
+				new(&reports[i]) ArenaReport();
+			}
+		}
 
 		jv::ArenaCreateInfo aInfo{};
 		aInfo.alloc = MAlloc;
 		aInfo.free = MFree;
+		aInfo.virtualMemory = info.virtualMemory;
+
+		jv::ArenaBlockCacheCreateInfo cacheInfo{};
+		cacheInfo.free = MFree;
+		cacheInfo.idleFrames = info.blockCacheIdleFrames;
+		blockCache.Init(cacheInfo);
+		aInfo.cache = info.virtualMemory ? nullptr : &blockCache;
 
 		aInfo.memorySize = info.tempSize;
+		aInfo.stats = arenaStats ? &arenaStats[TEMP] : nullptr;
 		arenas[TEMP] = jv::Arena::Create(aInfo);
+		arenaTypes[TEMP] = ArenaType::linear;
 		aInfo.memorySize = info.frameSize;
+		aInfo.stats = arenaStats ? &arenaStats[FRAM] : nullptr;
+		assert(info.framesInFlight > 0);
 		arenas[FRAM] = jv::Arena::Create(aInfo);
+		arenaTypes[FRAM] = ArenaType::linear;
+		pendingFramesLength = info.framesInFlight - 1;
+		pendingFrameIndex = 0;
+		pendingFrames = createPendingFrames(aInfo);
 
 		for (uint32_t i = 2; i < len; i++)
 		{
-			aInfo.memorySize = info.persistentInitSizes ? info.persistentInitSizes[i] : info.persistentDefaultSize;
-			arenas[i] = jv::Arena::Create(aInfo);
+			aInfo.memorySize = info.persistentInitSizes ? info.persistentInitSizes[RPERN(i)] : info.persistentDefaultSize;
+			arenaTypes[i] = info.persistentTypes ? info.persistentTypes[RPERN(i)] : ArenaType::linear;
+			aInfo.stats = arenaStats ? &arenaStats[i] : nullptr;
+
+			switch (arenaTypes[i])
+			{
+			case ArenaType::linear:
+				arenas[i] = jv::Arena::Create(aInfo);
+				break;
+			case ArenaType::concurrent:
+				concurrentArenas[i] = jv::ConcurrentArena::Create(aInfo);
+				break;
+			case ArenaType::tlsf:
+				tlsfArenas[i] = jv::Tlsf::Create(aInfo);
+				break;
+			}
 		}
 		arenasLength = len;
+
+		aInfo.stats = nullptr;
+		aInfo.memorySize = info.threadTempSize;
+		threadArenaInfos[TEMP] = aInfo;
+		aInfo.memorySize = info.threadFrameSize;
+		threadArenaInfos[FRAM] = aInfo;
+
+		threadArenasLength = std::thread::hardware_concurrency();
+		threadArenas = reinterpret_cast<ThreadArenas*>(malloc(sizeof(ThreadArenas) * threadArenasLength));
+		for (uint32_t i = 0; i < threadArenasLength; i++)
+			new(&threadArenas[i]) ThreadArenas();
+
+#ifdef MEM_PROFILE
+		p_initProfiler();
+#endif
 	}
 	void end()
 	{
 		assert(arenas);
+#ifdef MEM_PROFILE
+		p_endProfiler();
+#endif
 		for (uint32_t i = 0; i < arenasLength; i++)
-			jv::Arena::Destroy(arenas[i]);
+		{
+			switch (arenaTypes[i])
+			{
+			case ArenaType::linear:
+				jv::Arena::Destroy(arenas[i]);
+				break;
+			case ArenaType::concurrent:
+				jv::ConcurrentArena::Destroy(concurrentArenas[i]);
+				break;
+			case ArenaType::tlsf:
+				jv::Tlsf::Destroy(tlsfArenas[i]);
+				break;
+			}
+		}
 		free(arenas);
+		free(arenaTypes);
+		free(concurrentArenas);
+		free(tlsfArenas);
+		free(arenaStats);
+		free(reports);
+		destroyPendingFrames(pendingFrames);
 		arenas = nullptr;
+		pendingFrames = nullptr;
+		arenaStats = nullptr;
+		reports = nullptr;
+
+		for (uint32_t i = 0; i < threadArenasLength; i++)
+		{
+			if (!threadArenas[i].created)
+				continue;
+			jv::Arena::Destroy(threadArenas[i].arenas[TEMP]);
+			jv::Arena::Destroy(threadArenas[i].arenas[FRAM]);
+			destroyPendingFrames(threadArenas[i].pendingFrames);
+		}
+		free(threadArenas);
+		threadArenas = nullptr;
+
+		blockCache.Clear();
+	}
+	void p_bindThread(const uint32_t id)
+	{
+		assert(id < threadArenasLength);
+		boundThreadArenas = &threadArenas[id];
 	}
 	bool active()
 	{
 		return arenas;
 	}
+	const ArenaReport* report(const ARENA arena)
+	{
+		if (!reports || arenaTypes[arena] != ArenaType::linear)
+			return nullptr;
+		return &reports[arena];
+	}
+	bool saveSnapshot(const ARENA arena, const char* path, const void* root)
+	{
+		assert(arena >= PERS && arenaTypes[arena] == ArenaType::linear);
+		const auto& a = arenas[arena];
+		const uint64_t rootOffset = static_cast<const char*>(root) - static_cast<const char*>(a.memory);
+		return a.SaveSnapshot(path, rootOffset);
+	}
+	void* loadSnapshot(const ARENA arena, const char* path)
+	{
+		assert(arena >= PERS && arenaTypes[arena] == ArenaType::linear);
+		auto& a = arenas[arena];
+		uint64_t rootOffset;
+		if (!a.LoadSnapshot(path, rootOffset))
+			return nullptr;
+		return &static_cast<char*>(a.memory)[rootOffset];
+	}
+	void updateReports()
+	{
+		for (uint32_t i = 0; i < arenasLength; i++)
+		{
+			if (arenaTypes[i] != ArenaType::linear)
+				continue;
+
+			auto& stats = arenaStats[i];
+			auto& report = reports[i];
+			report.used = arenas[i].GetUsedMemory();
+			report.peak = stats.framePeak;
+			report.allocations = stats.frameAllocations;
+			report.spills = stats.frameSpills;
+			report.scopeDepth = stats.frameScopeDepth;
+
+			uint32_t bucket = 0;
+			while (bucket < 63 && stats.framePeak >> bucket)
+				++bucket;
+			++report.peakHistogram[bucket];
+
+			stats.frameAllocations = 0;
+			stats.frameSpills = 0;
+			stats.frameScopeDepth = stats.scopeDepth;
+		}
+	}
 	Scope scope(ARENA arena)
 	{
 		Scope scope{};
@@ -72,22 +307,93 @@ namespace mem
 		PScope(scope, arena, true);
 		return scope;
 	}
-	void* manualAlloc(ARENA arena, size_t size)
+	void* manualAlloc(ARENA arena, size_t size, size_t alignment)
+	{
+#ifdef MEM_PROFILE
+		p_profileAlloc(arena, size);
+#endif
+		switch (arenaTypes[arena])
+		{
+		case ArenaType::concurrent:
+			return concurrentArenas[arena].Alloc(size, alignment);
+		case ArenaType::tlsf:
+			return tlsfArenas[arena].Alloc(size, alignment);
+		default:
+			return getArena(arena).AllocAligned(size, alignment);
+		}
+	}
+	void manualFree(ARENA arena, void* ptr)
 	{
-		return arenas[arena].Alloc(size);
+		switch (arenaTypes[arena])
+		{
+		case ArenaType::linear:
+			getArena(arena).Free(ptr);
+			break;
+		case ArenaType::concurrent:
+			assert(false);
+			break;
+		case ArenaType::tlsf:
+			tlsfArenas[arena].Free(ptr);
+			break;
+		}
+	}
+	bool manualExtend(ARENA arena, void* ptr, size_t size)
+	{
+		if (arenaTypes[arena] != ArenaType::linear)
+			return false;
+		return getArena(arena).Extend(ptr, size);
+	}
+	void manualRelease(ARENA arena, void* ptr)
+	{
+		switch (arenaTypes[arena])
+		{
+		case ArenaType::linear:
+		{
+			auto& linear = getArena(arena);
+			if (linear.IsFront(ptr))
+				linear.Free(ptr);
+			break;
+		}
+		case ArenaType::concurrent:
+			break;
+		case ArenaType::tlsf:
+			tlsfArenas[arena].Free(ptr);
+			break;
+		}
+	}
+	uint32_t scopeDepth(ARENA arena)
+	{
+		if (arenaTypes[arena] != ArenaType::linear)
+			return 0;
+		return getArena(arena).openScopes;
 	}
 	void frame()
 	{
 #ifdef _DEBUG
-		jv::Arena* arena = &arenas[TEMP];
-		do
-		{
-			assert(arena->front == 0);
-			arena = arena->next;
-		} while (arena);
+		uint32_t depth;
+		uint64_t front;
+		arenas[TEMP].GetFront(depth, front);
+		assert(depth == 0 && front == 0);
 #endif // _DEBUG
 
-		arenas[FRAM].Clear();
+		if (reports)
+			updateReports();
+
+		// Worker FRAM arenas are rotated from this thread, so no task may be using one.
+		assert(!threadPoolActive() || threadPoolIdle());
+		nextFrame(arenas[FRAM], pendingFrames);
+		// Peaks carry over into the next frame from wherever the arenas are now.
+		if (arenaStats)
+			for (uint32_t i = 0; i < arenasLength; i++)
+				if (arenaTypes[i] == ArenaType::linear)
+					arenaStats[i].framePeak = arenas[i].GetUsedMemory();
+
+		for (uint32_t i = 0; i < threadArenasLength; i++)
+			if (threadArenas[i].created.load(std::memory_order_acquire))
+				nextFrame(threadArenas[i].arenas[FRAM], threadArenas[i].pendingFrames);
+		if (pendingFramesLength > 0)
+			pendingFrameIndex = (pendingFrameIndex + 1) % pendingFramesLength;
+		blockCache.Frame();
 	}
 	void Scope::clear()
 	{
@@ -101,7 +407,18 @@ namespace mem
 
 		if (!arenas)
 			return;
-		arenas[_arena].DestroyScope(_scope);
+		switch (arenaTypes[_arena])
+		{
+		case ArenaType::linear:
+			getArena(_arena).DestroyScope(_scope);
+			break;
+		case ArenaType::concurrent:
+			concurrentArenas[_arena].Clear();
+			break;
+		case ArenaType::tlsf:
+			tlsfArenas[_arena].Clear();
+			break;
+		}
 	}
 	Scope::~Scope()
 	{
@@ -1,4 +1,7 @@
 #pragma once
+#include "MemProfiler.h"
+#include <cstring>
+#include <type_traits>
 
 enum {
 	TEMP,
@@ -34,12 +37,53 @@ namespace mem
 		IScoped* _scoped = nullptr;
 	};
 
+	// Tag for container constructors that leave their elements uninitialised.
+	struct Uninit final {};
+	constexpr Uninit uninit{};
+
+	enum class ArenaType {
+		// Stack based, supports scopes and freeing the front allocation.
+		linear,
+		// Thread safe bump allocator. Scopes clear it as a whole, so they have to be created while it is empty.
+		concurrent,
+		// General purpose allocator that can free in any order through manualFree. Scopes clear it as a whole.
+		tlsf
+	};
+
+	// Usage of an arena over the last frame. Only tracked for the linear arenas of the main thread.
+	struct ArenaReport final {
+		// Bytes in use when the frame ended.
+		uint64_t used = 0;
+		uint64_t peak = 0;
+		uint64_t allocations = 0;
+		// Amount of times the arena overflowed into a chained block.
+		uint64_t spills = 0;
+		uint32_t scopeDepth = 0;
+		// Amount of frames per peak, where bucket i holds the frames that peaked below 2^i bytes.
+		uint32_t peakHistogram[64]{};
+	};
+
 	struct Info final {
-		uint32_t* persistentInitSizes = nullptr;
+		uint64_t* persistentInitSizes = nullptr;
+		// Defaults to linear for every persistent arena.
+		ArenaType* persistentTypes = nullptr;
 		uint32_t persistentLength = 0;
-		uint32_t persistentDefaultSize = 4096 * 256 * 32;
-		uint32_t tempSize = 4096 * 256 * 32;
-		uint32_t frameSize = 4096 * 256;
+		uint64_t persistentDefaultSize = 4096 * 256 * 32;
+		uint64_t tempSize = 4096 * 256 * 32;
+		uint64_t frameSize = 4096 * 256;
+		// FRAM allocations stay valid for this many calls to frame(), so that data used by frames the GPU is still
+		// working on is not overwritten. Should match the frames in flight of the swap chain.
+		uint32_t framesInFlight = 1;
+		// Every thread pool worker gets its own TEMP and FRAM arenas of these sizes.
+		uint64_t threadTempSize = 4096 * 256 * 4;
+		uint64_t threadFrameSize = 4096 * 256;
+		// Blocks chained by overflowing arenas are cached after use, and freed once they have not been reused for this many frames.
+		uint32_t blockCacheIdleFrames = 120;
+		// Treats the sizes above as reserved address space, committing physical memory only when it is used.
+		// Only applies to linear arenas.
+		bool virtualMemory = false;
+		// Tracks arena usage, which can be read through report after every frame.
+		bool stats = false;
 	};
 
 	void init(const Info& info = {});
@@ -48,19 +92,58 @@ namespace mem
 
 	Scope scope(ARENA arena);
 	Scope manualScope(ARENA arena);
-	void* manualAlloc(ARENA arena, size_t size);
+	void* manualAlloc(ARENA arena, size_t size, size_t alignment = 8);
+	// Linear arenas can only free their front allocation. Does not call destructors.
+	void manualFree(ARENA arena, void* ptr);
+	// Resizes an allocation without moving it, which only works for the front allocation of a linear arena.
+	// Returns false when it could not be resized, in which case the allocation is left untouched.
+	[[nodiscard]] bool manualExtend(ARENA arena, void* ptr, size_t size);
+	// Gives an allocation that is no longer used back where the arena allows it. TLSF arenas always free it, linear arenas
+	// only when it is their front allocation. Everything else stays in use until its scope is cleared.
+	void manualRelease(ARENA arena, void* ptr);
+	// Scopes that are open on a linear arena. Always 0 for the other arena types, since their scopes clear them as a whole.
+	[[nodiscard]] uint32_t scopeDepth(ARENA arena);
+	// Trivially constructible types are zeroed with a memset instead of being constructed one by one.
+	template <typename T>
+	T* alloc(ARENA arena, uint64_t count = 1);
+	// Skips construction entirely, for memory that is about to be overwritten.
 	template <typename T>
-	T* alloc(ARENA arena, uint32_t count = 1);
+	T* allocUninit(ARENA arena, uint64_t count = 1);
+	// Moves FRAM on to the next arena in its ring, and clears that one. Applies to every worker thread as well.
+	// The thread pool has to be idle and every FRAM scope closed, which debug builds assert.
 	void frame();
+	// Makes TEMP and FRAM allocations on the calling thread use the scratch arenas of worker id.
+	void p_bindThread(uint32_t id);
+	// Returns null when stats are disabled or the arena is not tracked.
+	[[nodiscard]] const ArenaReport* report(ARENA arena);
+	// Saves a linear persistent arena to a file, which is only valid when it holds no absolute pointers (see OffsetPtr).
+	// Root has to point into the arena, and is returned again when loading the snapshot.
+	bool saveSnapshot(ARENA arena, const char* path, const void* root);
+	// Loads a snapshot into an empty linear persistent arena. Returns the root, or null when it fails.
+	[[nodiscard]] void* loadSnapshot(ARENA arena, const char* path);
 
 	template<typename T>
-	T* alloc(ARENA arena, uint32_t count)
+	void p_construct(T* ptr, uint64_t count, std::true_type)
+	{
+		memset(ptr, 0, sizeof(T) * count);
+	}
+	template<typename T>
+	void p_construct(T* ptr, uint64_t count, std::false_type)
+	{
+		for (uint64_t i = 0; i < count; ++i)
+			new(&ptr[i]) T();
+	}
+	template<typename T>
+	T* alloc(ARENA arena, uint64_t count)
+	{
+		T* ptr = allocUninit<T>(arena, count);
+		p_construct(ptr, count, std::is_trivially_default_constructible<T>());
+		return ptr;
+	}
+	template<typename T>
+	T* allocUninit(ARENA arena, uint64_t count)
 	{
-		void* ptr = manualAlloc(arena, sizeof(T) * count);
-		T* ptrType = static_cast<T*>(ptr);
-		for (uint32_t i = 0; i < count; ++i)
-			new(&ptrType[i]) T();
-		return ptrType;
+		return static_cast<T*>(manualAlloc(arena, sizeof(T) * count, alignof(T)));
 	}
 }
 